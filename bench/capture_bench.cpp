@@ -0,0 +1,258 @@
+/*
+ * Driver type: GPhoto Camera INDI Driver
+ *
+ * Copyright (C) 2016 Marco Gulino (marco AT gulinux.net)
+ *
+ * This library is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+// End to end capture benchmark: file -> decode -> frame buffer, for JPEG files of several sensor sizes
+// (rendered by the simulation generator) and for any camera file given on the command line (i.e. RAW files).
+// Each fixture is decoded directly with ImageDecoder, then shot through ReplayCamera, which shares the shot queue and
+// chip publishing (ShotQueue), decoders and frame pool with RealCamera. Simulated shots go through SimulationCamera.
+// Full and Bayer decoding is also measured with 1, 2, 4... decode threads, up to all the cores.
+// Results are written as JSON, to stdout or to the file given with --json.
+//
+//     capture_bench [--json results.json] [--repeats N] [camera files...]
+#include "simulationgenerator.h"
+#include "simulationcamera.h"
+#include "replaycamera.h"
+#include "imagedecoder.h"
+#include "framepool.h"
+#include "parallel.h"
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+#include <sys/resource.h>
+
+using namespace std;
+using namespace INDI::GPhoto;
+
+namespace {
+class BenchCCD : public INDI::CCD {
+public:
+    const char *getDefaultName() { return "Capture Bench"; }
+    CCDChip &chip() { return PrimaryCCD; }
+};
+
+struct Fixture {
+    string name;
+    string path;
+    vector<uint8_t> data;
+};
+
+struct Result {
+    string fixture;
+    string stage;
+    string mode;
+    int threads;
+    int frames;
+    double seconds;
+    double megabytes; // input file size for each frame
+    double megapixels; // output frame size
+    double peak_rss_megabytes;
+    bool peak_rss_per_stage; // false when the peak could not be reset, and covers the whole process so far
+};
+
+/// Resets the peak resident set size to the current one, so that each measure gets its own peak (Linux 4.0 and later)
+bool reset_peak_rss()
+{
+    ofstream clear_refs{"/proc/self/clear_refs"};
+    return static_cast<bool>(clear_refs << "5" << flush);
+}
+
+/// Peak resident set size since the last reset, or since the process started when /proc is not available
+double peak_rss_megabytes()
+{
+    ifstream status{"/proc/self/status"};
+    string line;
+    while(getline(status, line))
+        if(line.compare(0, 6, "VmHWM:") == 0)
+            return stod(line.substr(6)) / 1024.0;
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss / 1024.0;
+}
+
+Result measure(const string &fixture, const string &stage, const string &mode, int frames, double megabytes, const function<double()> &run)
+{
+    double megapixels = 0;
+    const bool peak_rss_reset = reset_peak_rss();
+    auto started = chrono::steady_clock::now();
+    for(int frame = 0; frame < frames; frame++)
+        megapixels = run();
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+    return {fixture, stage, mode, Parallel::threads(), frames, seconds, megabytes, megapixels, peak_rss_megabytes(), peak_rss_reset};
+}
+
+double chip_megapixels(CCDChip &chip)
+{
+    return chip.getFrameBufferSize() / (chip.getBPP() / 8.0) / 1e6;
+}
+
+/// Shoots and publishes one frame, polling the camera like the driver would without event loop
+double shoot(Camera &camera, CCDChip &chip, const Frame::Region &region = {})
+{
+    if(! camera.shoot(Camera::Seconds{0}, region))
+        throw runtime_error("Unable to shoot");
+    while(camera.shoot_status().status != Camera::ShootStatus::Finished)
+        usleep(100);
+    if(! camera.write_image()(chip))
+        throw runtime_error("Unable to write image");
+    return chip_megapixels(chip);
+}
+
+string json(const vector<Result> &results)
+{
+    ostringstream out;
+    out << "{\n  \"benchmarks\": [\n";
+    for(size_t index = 0; index < results.size(); index++) {
+        auto &result = results[index];
+        out << "    {\"fixture\": \"" << result.fixture << "\", \"stage\": \"" << result.stage << "\", \"mode\": \"" << result.mode << "\""
+            << ", \"threads\": " << result.threads
+            << ", \"frames\": " << result.frames << ", \"seconds\": " << result.seconds
+            << ", \"frames_per_second\": " << result.frames / result.seconds
+            << ", \"input_megabytes_per_second\": " << result.megabytes * result.frames / result.seconds
+            << ", \"output_megapixels_per_second\": " << result.megapixels * result.frames / result.seconds
+            << ", \"peak_rss_megabytes\": " << result.peak_rss_megabytes
+            << ", \"peak_rss_per_stage\": " << (result.peak_rss_per_stage ? "true" : "false") << "}"
+            << (index + 1 < results.size() ? ",\n" : "\n");
+    }
+    out << "  ]\n}\n";
+    return out.str();
+}
+
+string basename(const string &path)
+{
+    return path.substr(path.rfind('/') + 1);
+}
+}
+
+int main(int argc, char **argv)
+{
+    string json_file;
+    int repeats = 5;
+    vector<Fixture> fixtures;
+    char temporary_directory[] = "/tmp/capture_bench_XXXXXX";
+    if(! mkdtemp(temporary_directory)) {
+        cerr << "Unable to create a temporary directory" << endl;
+        return 1;
+    }
+    for(int arg = 1; arg < argc; arg++) {
+        string value = argv[arg];
+        if(value == "--json" && arg + 1 < argc)
+            json_file = argv[++arg];
+        else if(value == "--repeats" && arg + 1 < argc)
+            repeats = max(1, atoi(argv[++arg]));
+        else
+            fixtures.push_back({basename(value), value, {}});
+    }
+    // Replayed files are linked in the temporary directory, next to the manifest
+    for(auto &fixture: fixtures) {
+        auto link = string{temporary_directory} + "/" + fixture.name;
+        char *target = realpath(fixture.path.c_str(), nullptr);
+        if(! target || symlink(target, link.c_str()) != 0) {
+            cerr << "Unable to use " << fixture.path << endl;
+            return 1;
+        }
+        free(target);
+        fixture.path = link;
+    }
+    // 12, 18 and 24 megapixel sensors
+    for(auto size: vector<pair<int, int>>{{4272, 2848}, {5184, 3456}, {6000, 4000}}) {
+        SimulationGenerator::Settings settings;
+        settings.width = size.first;
+        settings.height = size.second;
+        auto name = to_string(size.first) + "x" + to_string(size.second) + ".jpg";
+        auto path = string{temporary_directory} + "/" + name;
+        auto data = SimulationGenerator{settings}.jpeg({Camera::Seconds{30}, 800, 0});
+        ofstream{path, ios::binary}.write(reinterpret_cast<const char*>(data.data()), data.size());
+        fixtures.push_back({name, path, {}});
+    }
+
+    BenchCCD ccd;
+    CCDChip &chip = ccd.chip();
+    vector<Result> results;
+    const int cores = max(1u, thread::hardware_concurrency());
+    const vector<pair<string, ImageDecoder::Mode>> modes{{"full", ImageDecoder::FullImage}, {"half", ImageDecoder::HalfSize}, {"preview", ImageDecoder::Preview}, {"bayer", ImageDecoder::Bayer}, {"native", ImageDecoder::Native}};
+    try {
+        for(auto &fixture: fixtures) {
+            ifstream file{fixture.path, ios::binary};
+            fixture.data.assign(istreambuf_iterator<char>{file}, istreambuf_iterator<char>{});
+            if(fixture.data.empty())
+                throw runtime_error("Unable to read " + fixture.path);
+            const double megabytes = fixture.data.size() / 1e6;
+            cerr << fixture.name << ": " << megabytes << " MB" << endl;
+            auto pool = make_shared<FramePool>();
+            auto decode = [&](const string &stage, const pair<string, ImageDecoder::Mode> &mode) {
+                auto decoder = ImageDecoder::for_file(fixture.name, mode.second);
+                results.push_back(measure(fixture.name, stage, mode.first, repeats, megabytes, [&] {
+                    Frame frame{pool};
+                    decoder->decode(fixture.data.data(), fixture.data.size(), frame);
+                    return frame.geometry().pixels() * frame.geometry().channels / 1e6;
+                }));
+            };
+            for(auto &mode: modes) {
+                if(mode.second != ImageDecoder::Native)
+                    decode("decode", mode);
+            }
+            for(int threads = 1; threads <= cores; threads = threads < cores ? min(threads * 2, cores) : cores + 1) {
+                Parallel::set_threads(threads);
+                decode("decode scaling", modes[0]);
+                decode("decode scaling", modes[3]);
+            }
+            Parallel::set_threads(0);
+            // Whole pipeline: the file is read from disk by the worker thread, decoded and published to the chip
+            string manifest = string{temporary_directory} + "/manifest.txt";
+            ofstream{manifest} << fixture.name << " 0 0" << endl;
+            ReplayCamera camera{&ccd, temporary_directory};
+            remove(manifest.c_str());
+            for(auto &mode: modes) {
+                camera.set_decode_mode(mode.second);
+                results.push_back(measure(fixture.name, "replay", mode.first, repeats, megabytes, [&] { return shoot(camera, chip); }));
+            }
+            Frame::Region subframe;
+            subframe.x = subframe.y = 512;
+            subframe.width = subframe.height = 1024;
+            subframe.bin_x = subframe.bin_y = 2;
+            camera.set_decode_mode(ImageDecoder::FullImage);
+            results.push_back(measure(fixture.name, "replay", "subframe 1024 bin 2", repeats, megabytes, [&] { return shoot(camera, chip, subframe); }));
+        }
+        SimulationCamera simulation{&ccd};
+        for(auto &mode: modes) {
+            simulation.set_decode_mode(mode.second);
+            results.push_back(measure("simulation", "simulate", mode.first, repeats, 0, [&] { return shoot(simulation, chip); }));
+        }
+    } catch(std::exception &e) {
+        cerr << "Benchmark failed: " << e.what() << endl;
+        return 1;
+    }
+    for(auto &fixture: fixtures)
+        remove(fixture.path.c_str());
+    rmdir(temporary_directory);
+
+    if(json_file.empty())
+        cout << json(results);
+    else
+        ofstream{json_file} << json(results);
+    return 0;
+}
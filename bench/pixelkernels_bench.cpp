@@ -0,0 +1,145 @@
+/*
+ * Driver type: GPhoto Camera INDI Driver
+ *
+ * Copyright (C) 2016 Marco Gulino (marco AT gulinux.net)
+ *
+ * This library is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+// Times the pixel kernels on a 24 megapixel frame (6000x4000) with every instruction set supported by this CPU,
+// checking that each one gives the same output as the scalar implementation.
+#include "pixelkernels.h"
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <iomanip>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace INDI::GPhoto;
+
+namespace {
+const size_t pixels = 6000 * 4000;
+const int repeats = 10;
+
+double best_milliseconds(const function<void()> &run)
+{
+    double best = 0;
+    for(int repeat = 0; repeat < repeats; repeat++) {
+        auto started = chrono::steady_clock::now();
+        run();
+        double elapsed = chrono::duration<double, milli>(chrono::steady_clock::now() - started).count();
+        best = repeat == 0 ? elapsed : min(best, elapsed);
+    }
+    return best;
+}
+
+// Stacks 4 frames of random samples, clipping at one sigma so that many samples are rejected, and narrows the result
+template<typename T> void stack_frames(const T *source, vector<float> &means, vector<float> &m2, vector<float> &counts, vector<T> &destination)
+{
+    fill(means.begin(), means.end(), 0.f);
+    fill(m2.begin(), m2.end(), 0.f);
+    fill(counts.begin(), counts.end(), 0.f);
+    for(int frame = 0; frame < 4; frame++)
+        PixelKernels::stack(source + pixels * frame / 2, pixels, means.data(), m2.data(), counts.data(), 1.f);
+    PixelKernels::narrow(means.data(), pixels, destination.data());
+}
+
+struct Benchmark {
+    string name;
+    function<void()> run;
+    function<vector<uint8_t>()> output;
+};
+}
+
+int main()
+{
+    mt19937 random{42};
+    vector<uint8_t> rgb8(pixels * 3);
+    for(auto &value: rgb8)
+        value = random();
+    vector<uint16_t> rgbx16(pixels * 4);
+    for(auto &value: rgbx16)
+        value = random();
+    vector<float> offsets(pixels), gains(pixels);
+    for(size_t index = 0; index < pixels; index++) {
+        offsets[index] = random() % 4096 / 4.f;
+        gains[index] = 0.5f + random() % 1024 / 1024.f;
+    }
+    vector<uint8_t> planes8(pixels * 3);
+    vector<uint16_t> planes16(pixels * 3), widened(pixels * 3), swapped(pixels * 3), calibrated(pixels);
+    vector<uint8_t> calibrated8(pixels);
+    vector<float> means(pixels), m2(pixels), counts(pixels);
+    vector<uint16_t> stacked(pixels);
+    vector<uint8_t> stacked8(pixels);
+
+    auto bytes_of = [](const vector<uint16_t> &values) {
+        const uint8_t *data = reinterpret_cast<const uint8_t*>(values.data());
+        return vector<uint8_t>(data, data + values.size() * sizeof(uint16_t));
+    };
+    vector<Benchmark> benchmarks{
+        {"deinterleave RGB 8 bit", [&] {
+            uint8_t *planes[] = {planes8.data(), planes8.data() + pixels, planes8.data() + pixels * 2};
+            PixelKernels::deinterleave(rgb8.data(), pixels, 3, planes);
+        }, [&] { return planes8; }},
+        {"deinterleave RGBx 16 bit", [&] {
+            uint16_t *planes[] = {planes16.data(), planes16.data() + pixels, planes16.data() + pixels * 2};
+            PixelKernels::deinterleave(rgbx16.data(), pixels, 4, 3, planes);
+        }, [&] { return bytes_of(planes16); }},
+        {"widen 8 to 16 bit", [&] { PixelKernels::widen(rgb8.data(), rgb8.size(), widened.data()); }, [&] { return bytes_of(widened); }},
+        // Calibration works in place, so each run starts from a copy of the source samples
+        {"copy + calibrate 8 bit", [&] {
+            copy(rgb8.begin(), rgb8.begin() + pixels, calibrated8.begin());
+            PixelKernels::calibrate(calibrated8.data(), pixels, offsets.data(), gains.data());
+        }, [&] { return calibrated8; }},
+        {"copy + calibrate 16 bit", [&] {
+            copy(rgbx16.begin(), rgbx16.begin() + pixels, calibrated.begin());
+            PixelKernels::calibrate(calibrated.data(), pixels, offsets.data(), gains.data());
+        }, [&] { return bytes_of(calibrated); }},
+        {"sigma clipped stack x4 8 bit", [&] { stack_frames(rgb8.data(), means, m2, counts, stacked8); }, [&] { return stacked8; }},
+        {"sigma clipped stack x4 16 bit", [&] { stack_frames(rgbx16.data(), means, m2, counts, stacked); }, [&] { return bytes_of(stacked); }},
+        // Swapping works in place too, so each run starts from a copy of the source samples and swaps them once
+        {"copy + swap bytes", [&] {
+            copy(rgbx16.begin(), rgbx16.begin() + swapped.size(), swapped.begin());
+            PixelKernels::swap_bytes(swapped.data(), swapped.size());
+        }, [&] { return bytes_of(swapped); }},
+    };
+
+    int failures = 0;
+    cout << "Frame: " << pixels / 1000000.0 << " megapixels, best of " << repeats << " runs" << endl;
+    for(auto &benchmark: benchmarks) {
+        cout << benchmark.name << endl;
+        double scalar_milliseconds = 0;
+        vector<uint8_t> reference;
+        for(auto instruction_set: PixelKernels::supported()) {
+            PixelKernels::use(instruction_set);
+            double milliseconds = best_milliseconds(benchmark.run);
+            bool matches = true;
+            if(instruction_set == PixelKernels::Scalar) {
+                scalar_milliseconds = milliseconds;
+                reference = benchmark.output();
+            } else {
+                matches = benchmark.output() == reference;
+            }
+            failures += matches ? 0 : 1;
+            cout << "  " << setw(8) << left << PixelKernels::name(instruction_set) << right << fixed << setprecision(2)
+                 << setw(10) << milliseconds << " ms  x" << setprecision(2) << scalar_milliseconds / milliseconds
+                 << (matches ? "" : "  OUTPUT MISMATCH") << endl;
+        }
+    }
+    return failures == 0 ? 0 : 1;
+}
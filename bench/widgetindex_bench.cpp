@@ -0,0 +1,108 @@
+/*
+ * Driver type: GPhoto Camera INDI Driver
+ *
+ * Copyright (C) 2016 Marco Gulino (marco AT gulinux.net)
+ *
+ * This library is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+// Cost of a property update (one widget set plus one read back) on a configuration tree shaped like a modern camera body
+// (10 sections, 250 settings): walking the tree for each access, as child_by_name does, against the WidgetIndex lookup.
+// Fetching the configuration from the camera, avoided as well by the index, is not included.
+#include "widgetindex.h"
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace INDI::GPhoto;
+
+namespace {
+class Widget {
+public:
+    typedef shared_ptr<Widget> ptr;
+    Widget(const string &name) : _name{name} {}
+    string name() const { return _name; }
+    vector<ptr> children;
+    double value = 0;
+    vector<ptr> all_children() const {
+        vector<ptr> result;
+        for(auto child: children) {
+            result.push_back(child);
+            auto descendants = child->all_children();
+            result.insert(result.end(), descendants.begin(), descendants.end());
+        }
+        return result;
+    }
+    ptr child_by_name(const string &name) const {
+        for(auto child: children) {
+            if(child->name() == name)
+                return child;
+            if(auto found = child->child_by_name(name))
+                return found;
+        }
+        return {};
+    }
+private:
+    string _name;
+};
+
+Widget::ptr make_tree(int sections, int settings_per_section)
+{
+    auto root = make_shared<Widget>("main");
+    for(int section = 0; section < sections; section++) {
+        auto section_widget = make_shared<Widget>("section" + to_string(section));
+        for(int setting = 0; setting < settings_per_section; setting++)
+            section_widget->children.push_back(make_shared<Widget>("setting" + to_string(section) + "_" + to_string(setting)));
+        root->children.push_back(section_widget);
+    }
+    return root;
+}
+
+template<typename Find> double nanoseconds_per_update(const vector<string> &names, int rounds, Find find)
+{
+    auto started = chrono::steady_clock::now();
+    for(int round = 0; round < rounds; round++) {
+        for(auto &name: names) {
+            find(name)->value = round;
+            if(find(name)->value != round)
+                cerr << "Unexpected value for " << name << endl;
+        }
+    }
+    return chrono::duration<double, nano>(chrono::steady_clock::now() - started).count() / (rounds * names.size());
+}
+}
+
+int main()
+{
+    auto tree = make_tree(10, 25);
+    vector<string> names;
+    for(auto widget: tree->all_children())
+        names.push_back(widget->name());
+    const int rounds = 200;
+
+    double tree_walk = nanoseconds_per_update(names, rounds, [&](const string &name) { return tree->child_by_name(name); });
+    WidgetIndex<Widget> index{[&] { return tree; }};
+    double indexed = nanoseconds_per_update(names, rounds, [&](const string &name) { return index.find(name); });
+
+    cout << names.size() << " widgets, " << rounds * names.size() << " updates" << endl;
+    cout << fixed << setprecision(1);
+    cout << "  tree walk  " << setw(10) << tree_walk << " ns/update" << endl;
+    cout << "  index      " << setw(10) << indexed << " ns/update  x" << tree_walk / indexed << endl;
+    cout << "  index fetched the configuration " << index.statistics().fetches << " time(s)" << endl;
+    return 0;
+}
@@ -0,0 +1,85 @@
+/*
+ * Driver type: GPhoto Camera INDI Driver
+ *
+ * Copyright (C) 2016 Marco Gulino (marco AT gulinux.net)
+ *
+ * This library is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+#include "blobproperty.h"
+#include <cstring>
+
+using namespace std;
+using namespace INDI::GPhoto;
+
+class BlobProperty::Private {
+public:
+    Private(INDI::DefaultDevice *device, const string &name, const string &label, const string &group, BlobProperty *q);
+    INDI::DefaultDevice *device;
+    const string name;
+    const string label;
+    const string group;
+    IBLOB blob;
+    IBLOBVectorProperty property;
+    bool defined = false;
+private:
+    BlobProperty *q;
+};
+
+BlobProperty::Private::Private(INDI::DefaultDevice* device, const string& name, const string& label, const string& group, BlobProperty* q)
+    : device{device}, name{name}, label{label}, group{group}, q{q}
+{
+    IUFillBLOB(&blob, (name + "_DATA").c_str(), label.c_str(), "");
+}
+
+BlobProperty::BlobProperty(INDI::DefaultDevice* device, const string& name, const string& label, const string& group)
+    : dptr(device, name, label, group, this)
+{
+}
+
+BlobProperty::~BlobProperty()
+{
+    remove();
+}
+
+void BlobProperty::define()
+{
+    if(d->defined)
+        return;
+    IUFillBLOBVector(&d->property, &d->blob, 1, d->device->getDeviceName(), d->name.c_str(), d->label.c_str(), d->group.c_str(), IP_RO, 60, IPS_IDLE);
+    d->device->defineBLOB(&d->property);
+    d->defined = true;
+}
+
+void BlobProperty::remove()
+{
+    if(! d->defined)
+        return;
+    d->device->deleteProperty(d->name.c_str());
+    d->defined = false;
+}
+
+void BlobProperty::send(const uint8_t* data, size_t size, const string& format)
+{
+    if(! d->defined)
+        return;
+    d->blob.blob = const_cast<uint8_t*>(data);
+    d->blob.bloblen = d->blob.size = size;
+    strncpy(d->blob.format, format.c_str(), MAXINDIBLOBFMT - 1);
+    d->blob.format[MAXINDIBLOBFMT - 1] = 0;
+    d->property.s = IPS_OK;
+    IDSetBLOB(&d->property, nullptr);
+    d->blob.blob = nullptr;
+    d->blob.bloblen = d->blob.size = 0;
+}
@@ -0,0 +1,396 @@
+/*
+ * Driver type: GPhoto Camera INDI Driver
+ *
+ * Copyright (C) 2016 Marco Gulino (marco AT gulinux.net)
+ *
+ * This library is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+#include "calibration.h"
+#include <fitsio.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace std;
+using namespace INDI::GPhoto;
+
+namespace {
+void check_fits(int status, const string &operation, const string &path)
+{
+    if(status == 0)
+        return;
+    char message[FLEN_STATUS];
+    fits_get_errstatus(status, message);
+    throw runtime_error("Error " + operation + " calibration master " + path + ": " + message);
+}
+
+string lowercase(string value)
+{
+    transform(value.begin(), value.end(), value.begin(), ::tolower);
+    return value;
+}
+
+/// Cache file header, followed by the float planes; 64 bytes long, so that the planes are aligned for SIMD loads
+struct CacheHeader {
+    char magic[8];
+    uint64_t source_size;
+    int64_t source_mtime;
+    int32_t width;
+    int32_t height;
+    int32_t channels;
+    int32_t type;
+    char reserved[24];
+};
+static_assert(sizeof(CacheHeader) == 64, "Calibration cache header must be 64 bytes long");
+const char CACHE_MAGIC[8] = "GPHCAL1";
+}
+
+class Calibration::Master {
+public:
+    enum Type { Bias, Dark, Flat };
+    /// Reads the master header: returns an empty pointer for FITS files which are not masters
+    static shared_ptr<Master> open(const string &directory, const string &name);
+    ~Master();
+    string name;
+    Type type;
+    string iso;
+    double exposure = 0;
+    bool has_temperature = false;
+    double temperature = 0;
+    int width = 0;
+    int height = 0;
+    int channels = 1;
+    bool matches(int width, int height, int channels) const { return width == this->width && height == this->height && channels == this->channels; }
+    /// Planes of `width * height` floats, mapped from the cache file on first use
+    const float *pixels();
+private:
+    string path;
+    string cache_path;
+    mutex mapping_mutex;
+    void *mapping = nullptr;
+    size_t mapping_size = 0;
+    bool map_cache(const struct stat &source);
+    vector<float> read_planes() const;
+    void to_gains(vector<float> &planes) const;
+    void write_cache(const struct stat &source, const vector<float> &planes);
+};
+
+shared_ptr<Calibration::Master> Calibration::Master::open(const string& directory, const string& name)
+{
+    shared_ptr<Master> master{new Master};
+    master->name = name;
+    master->path = directory + "/" + name;
+    master->cache_path = directory + "/.cache/" + name + ".calibration";
+    fitsfile *fptr;
+    int status = 0;
+    fits_open_diskfile(&fptr, master->path.c_str(), READONLY, &status);
+    check_fits(status, "opening", master->path);
+    unique_ptr<fitsfile, void(*)(fitsfile*)> file{fptr, [](fitsfile *fptr) { int status = 0; fits_close_file(fptr, &status); }};
+    char value[FLEN_VALUE] = {0};
+    // INDI writes IMAGETYP ("Dark Frame"), other programs sometimes FRAME
+    if(fits_read_key(fptr, TSTRING, "IMAGETYP", value, nullptr, &status) != 0) {
+        status = 0;
+        fits_read_key(fptr, TSTRING, "FRAME", value, nullptr, &status);
+    }
+    string frame_type = lowercase(value);
+    if(status != 0 || (frame_type.find("bias") == string::npos && frame_type.find("dark") == string::npos && frame_type.find("flat") == string::npos))
+        return {};
+    master->type = frame_type.find("bias") != string::npos ? Bias : (frame_type.find("dark") != string::npos ? Dark : Flat);
+    if(fits_read_key(fptr, TDOUBLE, "EXPTIME", &master->exposure, nullptr, &status) != 0)
+        status = 0;
+    value[0] = 0;
+    if(fits_read_key(fptr, TSTRING, "ISOSPEED", value, nullptr, &status) != 0)
+        status = 0;
+    master->iso = value;
+    master->has_temperature = fits_read_key(fptr, TDOUBLE, "CCD-TEMP", &master->temperature, nullptr, &status) == 0;
+    status = 0;
+    int bitpix, naxis;
+    long naxes[3] = {0, 0, 1};
+    fits_get_img_param(fptr, 3, &bitpix, &naxis, naxes, &status);
+    check_fits(status, "reading", master->path);
+    if((naxis != 2 && naxis != 3) || (naxes[2] != 1 && naxes[2] != 3))
+        throw runtime_error("Calibration master " + master->path + " is not a mono or RGB image");
+    master->width = naxes[0];
+    master->height = naxes[1];
+    master->channels = naxes[2];
+    return master;
+}
+
+Calibration::Master::~Master()
+{
+    if(mapping)
+        munmap(mapping, mapping_size);
+}
+
+const float* Calibration::Master::pixels()
+{
+    lock_guard<mutex> lock(mapping_mutex);
+    if(! mapping) {
+        struct stat source;
+        if(stat(path.c_str(), &source) != 0)
+            throw runtime_error("Calibration master " + path + " not found");
+        if(! map_cache(source)) {
+            auto planes = read_planes();
+            if(type == Flat)
+                to_gains(planes);
+            write_cache(source, planes);
+        }
+    }
+    return reinterpret_cast<const float*>(reinterpret_cast<const uint8_t*>(mapping) + sizeof(CacheHeader));
+}
+
+bool Calibration::Master::map_cache(const struct stat &source)
+{
+    int fd = ::open(cache_path.c_str(), O_RDONLY | O_CLOEXEC);
+    if(fd < 0)
+        return false;
+    const size_t size = sizeof(CacheHeader) + sizeof(float) * width * height * channels;
+    CacheHeader header;
+    struct stat cache;
+    bool valid = fstat(fd, &cache) == 0 && static_cast<size_t>(cache.st_size) == size && read(fd, &header, sizeof(header)) == sizeof(header)
+        && memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) == 0 && header.source_size == static_cast<uint64_t>(source.st_size)
+        && header.source_mtime == source.st_mtime && header.width == width && header.height == height && header.channels == channels && header.type == type;
+    if(valid) {
+        int flags = MAP_SHARED;
+#ifdef MAP_POPULATE
+        // Masters are read for every frame: load them now rather than faulting pages in while decoding
+        flags |= MAP_POPULATE;
+#endif
+        void *mapped = mmap(nullptr, size, PROT_READ, flags, fd, 0);
+        if(mapped != MAP_FAILED) {
+            mapping = mapped;
+            mapping_size = size;
+        }
+    }
+    close(fd);
+    return mapping != nullptr;
+}
+
+vector<float> Calibration::Master::read_planes() const
+{
+    fitsfile *fptr;
+    int status = 0;
+    fits_open_diskfile(&fptr, path.c_str(), READONLY, &status);
+    check_fits(status, "opening", path);
+    // FITS stores NAXIS1 (width) first, then rows and planes: exactly the frame layout
+    vector<float> planes(static_cast<size_t>(width) * height * channels);
+    float null_value = 0;
+    int any_null;
+    fits_read_img(fptr, TFLOAT, 1, planes.size(), &null_value, planes.data(), &any_null, &status);
+    int close_status = 0;
+    fits_close_file(fptr, &close_status);
+    check_fits(status, "reading", path);
+    return planes;
+}
+
+void Calibration::Master::to_gains(vector<float> &planes) const
+{
+    // Each color is normalized to its own mean, so that flats don't change the white balance:
+    // colors are planes for RGB images, and the 2x2 cells of the color filter array for mono (Bayer) ones
+    const size_t plane_size = static_cast<size_t>(width) * height;
+    const int cells = channels == 1 ? 4 : 1;
+    auto cell_of = [&](size_t index) { return cells == 1 ? 0 : static_cast<int>(index / width % 2 * 2 + index % width % 2); };
+    for(int channel = 0; channel < channels; channel++) {
+        float *plane = planes.data() + channel * plane_size;
+        double sums[4] = {0};
+        size_t counts[4] = {0};
+        for(size_t index = 0; index < plane_size; index++) {
+            sums[cell_of(index)] += plane[index];
+            counts[cell_of(index)]++;
+        }
+        for(size_t index = 0; index < plane_size; index++) {
+            const int cell = cell_of(index);
+            const float mean = counts[cell] ? sums[cell] / counts[cell] : 0;
+            // Dead pixels in the flat are left as they are
+            plane[index] = plane[index] > 0 && mean > 0 ? mean / plane[index] : 1;
+        }
+    }
+}
+
+void Calibration::Master::write_cache(const struct stat &source, const vector<float> &planes)
+{
+    CacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    header.source_size = source.st_size;
+    header.source_mtime = source.st_mtime;
+    header.width = width;
+    header.height = height;
+    header.channels = channels;
+    header.type = type;
+    mkdir(cache_path.substr(0, cache_path.rfind('/')).c_str(), 0755);
+    // Written aside and renamed, so that another driver instance never maps a partial cache file
+    const string temporary_path = cache_path + "." + to_string(getpid());
+    {
+        ofstream cache{temporary_path, ios::binary | ios::trunc};
+        cache.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        cache.write(reinterpret_cast<const char*>(planes.data()), planes.size() * sizeof(float));
+        if(! cache)
+            remove(temporary_path.c_str());
+    }
+    if(rename(temporary_path.c_str(), cache_path.c_str()) == 0 && map_cache(source))
+        return;
+    // Read only masters directory: keep the converted master in anonymous memory instead
+    mapping_size = sizeof(CacheHeader) + planes.size() * sizeof(float);
+    void *mapped = mmap(nullptr, mapping_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(mapped == MAP_FAILED)
+        throw runtime_error("Unable to allocate calibration master " + path);
+    memcpy(mapped, &header, sizeof(header));
+    memcpy(reinterpret_cast<uint8_t*>(mapped) + sizeof(header), planes.data(), planes.size() * sizeof(float));
+    mapping = mapped;
+}
+
+string Calibration::Masters::description() const
+{
+    static const char *types[] = {"bias", "dark", "flat"};
+    string description;
+    for(auto master: {offset, flat}) {
+        if(master)
+            description += (description.empty() ? "" : ", ") + string{types[master->type]} + ": " + master->name;
+    }
+    return description;
+}
+
+Calibration::Rows::Rows(const Masters &masters, int width, int height, int channels) : masters(masters), width{width}, height{height}
+{
+    if(masters.offset && masters.offset->matches(width, height, channels))
+        offsets = masters.offset->pixels();
+    if(masters.flat && masters.flat->matches(width, height, channels))
+        gains = masters.flat->pixels();
+    if(! offsets && gains)
+        zeros.resize(width, 0);
+    if(offsets && ! gains)
+        ones.resize(width, 1);
+}
+
+const float* Calibration::Rows::offset(int channel, int y) const
+{
+    return offsets ? offsets + (static_cast<size_t>(channel) * height + y) * width : zeros.data();
+}
+
+const float* Calibration::Rows::gain(int channel, int y) const
+{
+    return gains ? gains + (static_cast<size_t>(channel) * height + y) * width : ones.data();
+}
+
+class Calibration::Private {
+public:
+    Private(Calibration *q);
+    Settings settings;
+    vector<shared_ptr<Master>> masters;
+    shared_ptr<Master> best(Master::Type type, const string &iso, const function<double(const Master &)> &distance) const;
+private:
+    Calibration *q;
+};
+
+Calibration::Private::Private(Calibration* q) : q{q}
+{
+}
+
+Calibration::Calibration() : dptr(this)
+{
+}
+
+Calibration::~Calibration()
+{
+}
+
+const Calibration::Settings& Calibration::settings() const
+{
+    return d->settings;
+}
+
+vector<string> Calibration::set_settings(const Settings& settings)
+{
+    vector<string> errors;
+    if(settings.directory != d->settings.directory) {
+        vector<shared_ptr<Master>> masters;
+        unique_ptr<DIR, int(*)(DIR*)> directory{settings.directory.empty() ? nullptr : opendir(settings.directory.c_str()), closedir};
+        if(! settings.directory.empty() && ! directory)
+            throw runtime_error("Unable to open the calibration masters directory " + settings.directory);
+        while(dirent *entry = directory ? readdir(directory.get()) : nullptr) {
+            string name = entry->d_name;
+            string extension = lowercase(name.substr(name.rfind('.') + 1));
+            if(extension != "fits" && extension != "fit" && extension != "fts")
+                continue;
+            try {
+                if(auto master = Master::open(settings.directory, name))
+                    masters.push_back(master);
+            } catch(std::exception &e) {
+                errors.push_back(e.what());
+            }
+        }
+        d->masters = masters;
+    }
+    d->settings = settings;
+    return errors;
+}
+
+string Calibration::summary() const
+{
+    int counts[3] = {0};
+    for(auto &master: d->masters)
+        counts[master->type]++;
+    ostringstream summary;
+    summary << counts[Master::Bias] << " bias, " << counts[Master::Dark] << " dark, " << counts[Master::Flat] << " flat";
+    return summary.str();
+}
+
+shared_ptr<Calibration::Master> Calibration::Private::best(Master::Type type, const string& iso, const function<double(const Master &)> &distance) const
+{
+    shared_ptr<Master> best;
+    double best_distance = 0;
+    for(auto &master: masters) {
+        if(master->type != type || (! master->iso.empty() && master->iso != iso))
+            continue;
+        if(settings.temperature_tolerance > 0 && master->has_temperature && abs(master->temperature - settings.temperature) > settings.temperature_tolerance)
+            continue;
+        // Masters taken with the same ISO win over the ones without ISO
+        double master_distance = distance(*master) + (master->iso.empty() ? 1e6 : 0);
+        if(! best || master_distance < best_distance) {
+            best = master;
+            best_distance = master_distance;
+        }
+    }
+    return best;
+}
+
+Calibration::Masters::ptr Calibration::masters_for(const string& iso, double exposure) const
+{
+    auto masters = make_shared<Masters>();
+    auto no_distance = [](const Master &) { return 0.; };
+    if(d->settings.dark) {
+        auto dark = d->best(Master::Dark, iso, [=](const Master &master) { return abs(master.exposure - exposure); });
+        if(dark && abs(dark->exposure - exposure) <= d->settings.exposure_tolerance * exposure)
+            masters->offset = dark;
+    }
+    if(! masters->offset && d->settings.bias)
+        masters->offset = d->best(Master::Bias, iso, no_distance);
+    if(d->settings.flat)
+        masters->flat = d->best(Master::Flat, iso, no_distance);
+    if(! masters->offset && ! masters->flat)
+        return {};
+    return masters;
+}
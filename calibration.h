@@ -0,0 +1,92 @@
+/*
+ * Driver type: GPhoto Camera INDI Driver
+ *
+ * Copyright (C) 2016 Marco Gulino (marco AT gulinux.net)
+ *
+ * This library is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+#ifndef INDI_GPHOTO_CALIBRATION_H
+#define INDI_GPHOTO_CALIBRATION_H
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "c++/dptr.h"
+
+namespace INDI {
+namespace GPhoto {
+/**
+ * Master bias, dark and flat frames, applied to the images while they are copied into frames (see FrameWriter).
+ * Masters are FITS files in a directory, described by their IMAGETYP, EXPTIME, ISOSPEED and CCD-TEMP keywords,
+ * as written by this driver: they must have the size of the decoded images (i.e. be taken with the same capture mode).
+ * Master flats are expected to be already bias subtracted, as produced by stacking programs.
+ *
+ * On first use each master is converted to 32 bit float planes in a cache file (".cache" in the masters directory),
+ * flats being stored as per pixel gains; the cache file is then memory mapped, and stays mapped for the next frames.
+ * Errors are reported by throwing std::runtime_error.
+ */
+class Calibration
+{
+public:
+    struct Settings {
+        std::string directory;
+        bool bias = false;
+        bool dark = false;
+        bool flat = false;
+        double exposure_tolerance = 0.05; ///< darks are used when their exposure is within this fraction of the frame one
+        double temperature = 0;
+        double temperature_tolerance = 0; ///< 0: temperature is not checked
+    };
+    class Master;
+    /// Masters selected for a shot: the offset is the dark, or the bias when no dark matches
+    struct Masters {
+        typedef std::shared_ptr<const Masters> ptr;
+        std::shared_ptr<Master> offset;
+        std::shared_ptr<Master> flat;
+        std::string description() const;
+    };
+    /// Calibration rows of the masters matching the size of an image; masters of a different size are ignored
+    class Rows {
+    public:
+        Rows(const Masters &masters, int width, int height, int channels);
+        bool active() const { return offsets || gains; }
+        const float *offset(int channel, int y) const;
+        const float *gain(int channel, int y) const;
+    private:
+        Masters masters;
+        int width;
+        int height;
+        const float *offsets = nullptr;
+        const float *gains = nullptr;
+        std::vector<float> zeros;
+        std::vector<float> ones;
+    };
+
+    Calibration();
+    ~Calibration();
+    /// Rescans the masters directory when changed, returning the errors of the FITS files which could not be read
+    std::vector<std::string> set_settings(const Settings &settings);
+    const Settings &settings() const;
+    /// Number of masters of each type found, i.e. "1 bias, 4 dark, 1 flat"
+    std::string summary() const;
+    /// Masters for a frame shot with `iso` and `exposure` seconds; empty when calibration is disabled or nothing matches
+    Masters::ptr masters_for(const std::string &iso, double exposure) const;
+private:
+    D_PTR;
+};
+}
+}
+
+#endif // INDI_GPHOTO_CALIBRATION_H
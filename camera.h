@@ -25,6 +25,9 @@
 #include <functional>
 #include <indiccd.h>
 #include <indi_properties.h>
+#include "imagedecoder.h"
+#include "liveview.h"
+#include "framestatistics.h"
 
 namespace INDI {
 namespace GPhoto {
@@ -33,23 +36,63 @@ public:
   typedef std::chrono::duration<double> Seconds;
   typedef std::shared_ptr<Camera> ptr;
   typedef std::function<bool(CCDChip &chip)> WriteImage;
+  typedef std::function<void()> Notify;
   virtual std::vector<std::string> available_iso() = 0;
   virtual std::string current_iso() = 0;
   virtual bool set_iso(const std::string &iso) = 0;
   virtual std::vector< std::string > available_formats() = 0;
   virtual std::string current_format() = 0;
   virtual bool set_format(const std::string& format) = 0;
+  virtual void set_decode_mode(ImageDecoder::Mode mode) = 0;
+  /// Threads the frames of the next shots are decoded with, 0 meaning one for each core
+  virtual void set_decode_threads(int threads) = 0;
+  /// Masters applied while decoding the frames of the next shots (none when empty)
+  virtual void set_calibration(const Calibration::Masters::ptr &calibration) = 0;
+  /// Statistics computed while decoding the frames of the next shots
+  virtual void set_statistics_mode(FrameStatistics::Mode mode) = 0;
   
   struct ShootStatus {
-    enum Status { Idle, Running, Finished };
+    enum Status { Idle, Running, Downloading, Finished };
     Status status;
     Seconds elapsed;
     Seconds remaining;
   };
-  virtual bool shoot(Seconds seconds) = 0;
+  struct Preview {
+    typedef std::shared_ptr<Preview> ptr;
+    std::vector<uint8_t> data;
+    std::string format;
+  };
+  struct FrameTimings {
+    Seconds exposure;
+    Seconds download;
+    Seconds decode;
+    Seconds total;
+    Seconds wait; ///< from the end of decoding to write_image() being called
+    Seconds publish; ///< handing the frame buffer over to the chip
+    std::size_t bytes; ///< size of the camera file
+  };
+  /// Starts an exposure: the image will be cropped to `region` and binned while decoding
+  virtual bool shoot(Seconds seconds, const Frame::Region &region) = 0;
+  virtual bool can_shoot() const = 0;
+  /// Drops the shots not published yet; an exposure the camera can't interrupt still prevents new shots until it ends
+  virtual void abort() = 0;
+  virtual std::size_t frames_in_flight() const = 0;
   virtual ShootStatus shoot_status() const = 0;
+  virtual FrameTimings last_frame_timings() const = 0;
+  /// Statistics of the last frame written by write_image(), not valid when disabled or for native files
+  virtual FrameStatistics::Result last_frame_statistics() const = 0;
+  virtual std::string bayer_pattern() const = 0;
+  virtual Preview::ptr take_preview() = 0;
+  virtual bool start_live_view() = 0;
+  virtual void stop_live_view() = 0;
+  virtual Frame::ptr live_view_frame() = 0;
+  virtual LiveView::Stats live_view_stats() const = 0;
   virtual WriteImage write_image() const = 0;
+  /// Called, possibly from another thread, when shoot_status() or take_preview() may have something new to report
+  virtual void set_frame_ready_callback(const Notify &frame_ready) = 0;
   virtual void setup_properties(INDI::Properties::Properties< std::string > &properties) = 0;
+  /// True when the camera settings turned out to differ from the ones the properties were set up with
+  virtual bool settings_changed() const = 0;
 };
 }
 }
@@ -0,0 +1,43 @@
+/*
+ * Driver type: GPhoto Camera INDI Driver
+ *
+ * Copyright (C) 2016 Marco Gulino (marco AT gulinux.net)
+ *
+ * This library is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+#include "detectedcameras.h"
+#include <gphoto2/gphoto2.h>
+
+using namespace std;
+using namespace INDI::GPhoto;
+
+vector<DetectedCamera> INDI::GPhoto::detect_cameras()
+{
+    vector<DetectedCamera> cameras;
+    GPContext *context = gp_context_new();
+    CameraList *list = nullptr;
+    if(gp_list_new(&list) == GP_OK && gp_camera_autodetect(list, context) >= GP_OK) {
+        for(int index = 0; index < gp_list_count(list); index++) {
+            const char *model = nullptr;
+            const char *port = nullptr;
+            if(gp_list_get_name(list, index, &model) == GP_OK && gp_list_get_value(list, index, &port) == GP_OK)
+                cameras.push_back({model, port});
+        }
+    }
+    if(list)
+        gp_list_free(list);
+    gp_context_unref(context);
+    return cameras;
+}
@@ -0,0 +1,37 @@
+/*
+ * Driver type: GPhoto Camera INDI Driver
+ *
+ * Copyright (C) 2016 Marco Gulino (marco AT gulinux.net)
+ *
+ * This library is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+#ifndef INDI_GPHOTO_DETECTEDCAMERAS_H
+#define INDI_GPHOTO_DETECTEDCAMERAS_H
+
+#include <string>
+#include <vector>
+
+namespace INDI {
+namespace GPhoto {
+struct DetectedCamera {
+    std::string model;
+    std::string port;
+};
+/// Cameras currently attached, as listed by gphoto2 autodetection: this is quick, since no camera is opened.
+std::vector<DetectedCamera> detect_cameras();
+}
+}
+
+#endif // INDI_GPHOTO_DETECTEDCAMERAS_H
@@ -0,0 +1,85 @@
+/*
+ * Driver type: GPhoto Camera INDI Driver
+ *
+ * Copyright (C) 2016 Marco Gulino (marco AT gulinux.net)
+ *
+ * This library is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+#include "eventnotifier.h"
+#include <atomic>
+#include <stdexcept>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <fcntl.h>
+#include <eventloop.h>
+
+using namespace std;
+using namespace INDI::GPhoto;
+
+class EventNotifier::Private {
+public:
+    Private(const Callback &callback, EventNotifier *q);
+    Callback callback;
+    int pipe_fds[2] = {-1, -1};
+    int callback_id = -1;
+    atomic<bool> pending{false};
+    static void readable(int fd, void *self);
+private:
+    EventNotifier *q;
+};
+
+EventNotifier::Private::Private(const Callback& callback, EventNotifier* q) : callback{callback}, q{q}
+{
+}
+
+EventNotifier::EventNotifier(const Callback& callback) : dptr(callback, this)
+{
+    if(pipe(d->pipe_fds) != 0)
+        throw runtime_error(string{"Unable to create notification pipe: "} + strerror(errno));
+    for(auto fd: d->pipe_fds) {
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+    }
+    d->callback_id = IEAddCallback(d->pipe_fds[0], &Private::readable, d.get());
+}
+
+EventNotifier::~EventNotifier()
+{
+    IERmCallback(d->callback_id);
+    close(d->pipe_fds[0]);
+    close(d->pipe_fds[1]);
+}
+
+void EventNotifier::notify()
+{
+    // A single byte in the pipe is enough to wake up the event loop
+    if(d->pending.exchange(true))
+        return;
+    char byte = 1;
+    if(write(d->pipe_fds[1], &byte, 1) < 0 && errno != EAGAIN)
+        d->pending = false;
+}
+
+void EventNotifier::Private::readable(int fd, void* self)
+{
+    auto d = reinterpret_cast<EventNotifier::Private*>(self);
+    // Cleared only once the pipe is drained, or a byte written in between would be consumed while pending stays set.
+    // Events happening after this point write a new byte; those happening before it are seen by the callback below.
+    char buffer[64];
+    while(read(fd, buffer, sizeof(buffer)) > 0);
+    d->pending = false;
+    d->callback();
+}
@@ -0,0 +1,46 @@
+/*
+ * Driver type: GPhoto Camera INDI Driver
+ *
+ * Copyright (C) 2016 Marco Gulino (marco AT gulinux.net)
+ *
+ * This library is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+#ifndef INDI_GPHOTO_EVENTNOTIFIER_H
+#define INDI_GPHOTO_EVENTNOTIFIER_H
+
+#include <functional>
+#include "c++/dptr.h"
+
+namespace INDI {
+namespace GPhoto {
+/**
+ * Wakes up the INDI event loop from other threads, through a pipe watched by the event loop.
+ * notify() can be called from any thread; the callback is then run by the event loop.
+ * Notifications sent before the callback runs are merged into a single call.
+ */
+class EventNotifier
+{
+public:
+    typedef std::function<void()> Callback;
+    EventNotifier(const Callback &callback);
+    ~EventNotifier();
+    void notify();
+private:
+    D_PTR;
+};
+}
+}
+
+#endif // INDI_GPHOTO_EVENTNOTIFIER_H
@@ -0,0 +1,111 @@
+/*
+ * Driver type: GPhoto Camera INDI Driver
+ *
+ * Copyright (C) 2016 Marco Gulino (marco AT gulinux.net)
+ *
+ * This library is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+#include "fitscompressor.h"
+#include <stdexcept>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+
+using namespace std;
+using namespace INDI::GPhoto;
+
+namespace {
+void check_fits(int status, const string &operation)
+{
+    if(status == 0)
+        return;
+    char message[FLEN_STATUS];
+    fits_get_errstatus(status, message);
+    throw runtime_error("Error " + operation + " FITS file: " + message);
+}
+
+/// FITS file written in memory, closed and released on destruction unless released first
+class MemoryFits {
+public:
+    MemoryFits() {
+        int status = 0;
+        fits_create_memfile(&fptr, &buffer, &size, 2880 * 64, realloc, &status);
+        check_fits(status, "creating");
+    }
+    ~MemoryFits() {
+        int status = 0;
+        if(fptr)
+            fits_close_file(fptr, &status);
+        free(buffer);
+    }
+    vector<uint8_t> close() {
+        int status = 0;
+        fits_close_file(fptr, &status);
+        fptr = nullptr;
+        check_fits(status, "writing");
+        return {reinterpret_cast<uint8_t*>(buffer), reinterpret_cast<uint8_t*>(buffer) + size};
+    }
+    fitsfile *fptr = nullptr;
+private:
+    void *buffer = nullptr;
+    size_t size = 0;
+};
+}
+
+FitsCompressor::Image FitsCompressor::capture(CCDChip& chip, const function<void(fitsfile *fptr)> &add_keywords)
+{
+    Image image;
+    image.width = chip.getSubW() / chip.getBinX();
+    image.height = chip.getSubH() / chip.getBinY();
+    image.channels = chip.getNAxis() == 3 ? 3 : 1;
+    image.bpp = chip.getBPP();
+    image.pixels.assign(chip.getFrameBuffer(), chip.getFrameBuffer() + chip.getFrameBufferSize());
+
+    // Keywords are written to a header only file, then copied as text records, since they are read from the driver state
+    MemoryFits header;
+    int status = 0;
+    fits_create_img(header.fptr, image.bpp == 8 ? BYTE_IMG : USHORT_IMG, 0, nullptr, &status);
+    check_fits(status, "creating");
+    add_keywords(header.fptr);
+    static const char *structural_keywords[] = {"SIMPLE", "BITPIX", "NAXIS*", "EXTEND", "BZERO", "BSCALE"};
+    char *records = nullptr;
+    int keys = 0;
+    fits_hdr2str(header.fptr, 0, const_cast<char**>(structural_keywords), 6, &records, &keys, &status);
+    check_fits(status, "reading keywords from");
+    image.header.assign(records, strlen(records));
+    free(records);
+    return image;
+}
+
+FitsCompressor::Result FitsCompressor::compress(const Image& image, const Settings& settings)
+{
+    auto started = chrono::steady_clock::now();
+    static const int codecs[] = {0, RICE_1, HCOMPRESS_1, GZIP_1};
+    MemoryFits file;
+    int status = 0;
+    fits_set_compression_type(file.fptr, codecs[settings.codec], &status);
+    if(settings.codec == HCompress)
+        fits_set_hcomp_scale(file.fptr, settings.level, &status);
+    long axes[] = {image.width, image.height, image.channels};
+    fits_create_img(file.fptr, image.bpp == 8 ? BYTE_IMG : USHORT_IMG, image.channels == 3 ? 3 : 2, axes, &status);
+    check_fits(status, "creating");
+    for(size_t record = 0; record + 80 <= image.header.size(); record += 80)
+        fits_write_record(file.fptr, image.header.substr(record, 80).c_str(), &status);
+    const LONGLONG pixels = static_cast<LONGLONG>(image.width) * image.height * image.channels;
+    fits_write_img(file.fptr, image.bpp == 8 ? TBYTE : TUSHORT, 1, pixels, const_cast<uint8_t*>(image.pixels.data()), &status);
+    check_fits(status, "compressing");
+    auto compressed = file.close();
+    return {compressed, image.pixels.size(), chrono::steady_clock::now() - started};
+}
@@ -0,0 +1,64 @@
+/*
+ * Driver type: GPhoto Camera INDI Driver
+ *
+ * Copyright (C) 2016 Marco Gulino (marco AT gulinux.net)
+ *
+ * This library is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+#ifndef INDI_GPHOTO_FITSCOMPRESSOR_H
+#define INDI_GPHOTO_FITSCOMPRESSOR_H
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <functional>
+#include <cstdint>
+#include <indiccd.h>
+#include <fitsio.h>
+
+namespace INDI {
+namespace GPhoto {
+/**
+ * Tile compressed FITS files (the ".fits.fz" format of fpack), written with cfitsio.
+ * capture() copies the image and the FITS keywords from the chip, and must be called from the INDI event loop;
+ * compress() only works on that copy, so that it can be run by a worker thread.
+ * Errors are reported by throwing std::runtime_error.
+ */
+struct FitsCompressor {
+    enum Codec { None, Rice, HCompress, GZip };
+    struct Settings {
+        Codec codec;
+        float level; ///< HCOMPRESS scale factor: 0 is lossless
+    };
+    struct Image {
+        std::vector<uint8_t> pixels;
+        int width;
+        int height;
+        int channels;
+        int bpp;
+        std::string header; ///< 80 characters keyword records
+    };
+    struct Result {
+        std::vector<uint8_t> file;
+        std::size_t raw_bytes;
+        std::chrono::duration<double> elapsed;
+    };
+    static Image capture(CCDChip &chip, const std::function<void(fitsfile *fptr)> &add_keywords);
+    static Result compress(const Image &image, const Settings &settings);
+};
+}
+}
+
+#endif // INDI_GPHOTO_FITSCOMPRESSOR_H
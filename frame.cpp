@@ -0,0 +1,117 @@
+/*
+ * Driver type: GPhoto Camera INDI Driver
+ *
+ * Copyright (C) 2016 Marco Gulino (marco AT gulinux.net)
+ *
+ * This library is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+#include "frame.h"
+#include "framepool.h"
+#include "framestatistics.h"
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+using namespace std;
+using namespace INDI::GPhoto;
+
+Frame::Frame(const shared_ptr<FramePool> &pool) : _geometry{0, 0, 0, 0}, full_width{0}, full_height{0}, buffer{nullptr}, buffer_geometry{0, 0, 0, 0}, pool{pool}
+{
+}
+
+Frame::~Frame()
+{
+    release_buffer();
+}
+
+void Frame::release_buffer()
+{
+    if(pool)
+        pool->release(buffer, buffer_geometry);
+    else
+        free(buffer);
+    buffer = nullptr;
+    buffer_geometry = {0, 0, 0, 0};
+}
+
+void Frame::resize(const Frame::Geometry& geometry)
+{
+    _geometry = geometry;
+    _bayer_pattern.clear();
+    set_region({}, 0, 0);
+    if(pool) {
+        if(buffer && geometry == buffer_geometry)
+            return;
+        release_buffer();
+        buffer = pool->acquire(geometry);
+        buffer_geometry = geometry;
+        return;
+    }
+    if(geometry.bytes() <= buffer_geometry.bytes())
+        return;
+    uint8_t *new_buffer = reinterpret_cast<uint8_t*>(realloc(buffer, geometry.bytes()));
+    if(! new_buffer)
+        throw bad_alloc();
+    buffer = new_buffer;
+    buffer_geometry = geometry;
+}
+
+void Frame::set_region(const Region& region, int full_width, int full_height)
+{
+    _region = region;
+    this->full_width = full_width;
+    this->full_height = full_height;
+}
+
+void Frame::publish(CCDChip& chip)
+{
+    // INDI computes the image size from the subframe and binning, so they must match the frame geometry exactly
+    if(_region.whole()) {
+        chip.setResolution(_geometry.width, _geometry.height);
+        chip.setBin(1, 1);
+        chip.setFrame(0, 0, _geometry.width, _geometry.height);
+    } else {
+        chip.setResolution(full_width, full_height);
+        chip.setBin(_region.bin_x, _region.bin_y);
+        chip.setFrame(_region.x, _region.y, _geometry.width * _region.bin_x, _geometry.height * _region.bin_y);
+    }
+    chip.setNAxis(_geometry.channels == 3 ? 3 : 2);
+    chip.setBPP(_geometry.bpp);
+    // CCDChip allocates its frame buffer with malloc/realloc and releases it with free, just like we do, so we can safely exchange ownership.
+    uint8_t *chip_buffer = chip.getFrameBuffer();
+    Geometry chip_buffer_geometry{chip.getFrameBufferSize(), 1, 1, 8};
+    if(pool) {
+        chip_buffer_geometry = pool->published(buffer_geometry);
+        // The chip buffer was resized outside of the pool, it can't be reused by geometry
+        if(chip_buffer_geometry.bytes() != static_cast<size_t>(chip.getFrameBufferSize()))
+            chip_buffer_geometry = {0, 0, 0, 0};
+    }
+    chip.setFrameBuffer(buffer);
+    chip.setFrameBufferSize(_geometry.bytes(), false);
+    buffer = chip_buffer;
+    buffer_geometry = chip_buffer_geometry;
+    _geometry = {0, 0, 0, 0};
+    _bayer_pattern.clear();
+    _calibration.reset();
+    _statistics.reset();
+    set_region({}, 0, 0);
+}
+
+void Frame::publish_file(CCDChip& chip, const uint8_t* data, size_t size, const string& extension)
+{
+    chip.setFrameBufferSize(size);
+    memcpy(chip.getFrameBuffer(), data, size);
+    chip.setImageExtension(extension.c_str());
+}
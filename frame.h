@@ -0,0 +1,114 @@
+/*
+ * Driver type: GPhoto Camera INDI Driver
+ *
+ * Copyright (C) 2016 Marco Gulino (marco AT gulinux.net)
+ *
+ * This library is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+#ifndef INDI_GPHOTO_FRAME_H
+#define INDI_GPHOTO_FRAME_H
+
+#include <memory>
+#include <string>
+#include <cstdint>
+#include <cstddef>
+#include <indiccd.h>
+#include "calibration.h"
+
+namespace INDI {
+namespace GPhoto {
+class FramePool;
+class FrameStatistics;
+/**
+ * Decoded image, stored as consecutive planes (one per channel) in a single malloc'ed buffer.
+ * The buffer layout is exactly what CCDChip expects, so publishing a frame just hands the buffer over to the chip.
+ * When a FramePool is given, buffers are taken from and given back to the pool instead of being allocated for each frame.
+ */
+class Frame
+{
+public:
+    typedef std::shared_ptr<Frame> ptr;
+    struct Geometry {
+        int width;
+        int height;
+        int channels;
+        int bpp;
+        std::size_t pixels() const { return static_cast<std::size_t>(width) * height; }
+        std::size_t plane_bytes() const { return pixels() * bpp / 8; }
+        std::size_t bytes() const { return plane_bytes() * channels; }
+        bool operator==(const Geometry &other) const { return width == other.width && height == other.height && channels == other.channels && bpp == other.bpp; }
+    };
+    /**
+     * Part of the decoded image requested by the client, in unbinned pixels, and its binning.
+     * A zero width or height selects the whole image.
+     */
+    struct Region {
+        int x = 0;
+        int y = 0;
+        int width = 0;
+        int height = 0;
+        int bin_x = 1;
+        int bin_y = 1;
+        bool sum = false; ///< binned pixels are summed instead of averaged
+        bool whole() const { return width <= 0 || height <= 0; }
+        bool binned() const { return bin_x > 1 || bin_y > 1; }
+    };
+    Frame(const std::shared_ptr<FramePool> &pool = {});
+    ~Frame();
+    Frame(const Frame &) = delete;
+    Frame &operator=(const Frame &) = delete;
+
+    const Geometry &geometry() const { return _geometry; }
+    void resize(const Geometry &geometry);
+    uint8_t *data() const { return buffer; }
+    template<typename T> T *plane(int channel) const { return reinterpret_cast<T*>(buffer + _geometry.plane_bytes() * channel); }
+    /// Color filter array pattern (i.e. "RGGB") for undemosaiced frames, empty otherwise
+    const std::string &bayer_pattern() const { return _bayer_pattern; }
+    void set_bayer_pattern(const std::string &bayer_pattern) { _bayer_pattern = bayer_pattern; }
+    /// Region of the full image this frame holds, its size being the width and height of the full image
+    const Region &region() const { return _region; }
+    void set_region(const Region &region, int full_width, int full_height);
+    /// Masters applied by FrameWriter while writing the frame; set before decoding, kept when resizing
+    const Calibration::Masters::ptr &calibration() const { return _calibration; }
+    void set_calibration(const Calibration::Masters::ptr &calibration) { _calibration = calibration; }
+    /// Statistics computed by FrameWriter while writing the frame; set before decoding, like the calibration
+    const std::shared_ptr<FrameStatistics> &statistics() const { return _statistics; }
+    void set_statistics(const std::shared_ptr<FrameStatistics> &statistics) { _statistics = statistics; }
+
+    /**
+     * Swaps the frame buffer with the chip frame buffer, so that no pixel is copied.
+     * The chip resolution is set to the full image size, and its subframe and binning to the frame region.
+     * The frame is left with the previous chip buffer, and no geometry.
+     */
+    void publish(CCDChip &chip);
+    /// Copies a camera file to the chip buffer unmodified, to be sent with its own extension instead of being converted to FITS
+    static void publish_file(CCDChip &chip, const uint8_t *data, std::size_t size, const std::string &extension);
+private:
+    void release_buffer();
+    Geometry _geometry;
+    std::string _bayer_pattern;
+    Region _region;
+    Calibration::Masters::ptr _calibration;
+    std::shared_ptr<FrameStatistics> _statistics;
+    int full_width;
+    int full_height;
+    uint8_t *buffer;
+    Geometry buffer_geometry;
+    std::shared_ptr<FramePool> pool;
+};
+}
+}
+
+#endif // INDI_GPHOTO_FRAME_H
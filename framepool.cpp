@@ -0,0 +1,127 @@
+/*
+ * Driver type: GPhoto Camera INDI Driver
+ *
+ * Copyright (C) 2016 Marco Gulino (marco AT gulinux.net)
+ *
+ * This library is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+#include "framepool.h"
+#include <map>
+#include <vector>
+#include <tuple>
+#include <mutex>
+#include <new>
+#include <cstdlib>
+
+using namespace std;
+using namespace INDI::GPhoto;
+
+class FramePool::Private {
+public:
+    Private(size_t max_spares_per_geometry, FramePool *q);
+    typedef tuple<int, int, int, int> Key;
+    static Key key(const Frame::Geometry &geometry) { return make_tuple(geometry.width, geometry.height, geometry.channels, geometry.bpp); }
+    const size_t max_spares_per_geometry;
+    mutable mutex spares_mutex;
+    map<Key, vector<uint8_t*>> spares;
+    Frame::Geometry published;
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+private:
+    FramePool *q;
+};
+
+FramePool::Private::Private(size_t max_spares_per_geometry, FramePool* q) : max_spares_per_geometry{max_spares_per_geometry}, published{0, 0, 0, 0}, q{q}
+{
+}
+
+FramePool::FramePool(size_t max_spares_per_geometry) : dptr(max_spares_per_geometry, this)
+{
+}
+
+FramePool::~FramePool()
+{
+    clear();
+}
+
+uint8_t* FramePool::acquire(const Frame::Geometry& geometry)
+{
+    {
+        lock_guard<mutex> lock(d->spares_mutex);
+        // Geometry changed: spare buffers of other geometries are not going to be used anymore
+        for(auto &spares: d->spares) {
+            if(spares.first != Private::key(geometry)) {
+                for(auto buffer: spares.second)
+                    free(buffer);
+                spares.second.clear();
+            }
+        }
+        auto &spares = d->spares[Private::key(geometry)];
+        if(! spares.empty()) {
+            d->hits++;
+            uint8_t *buffer = spares.back();
+            spares.pop_back();
+            return buffer;
+        }
+        d->misses++;
+    }
+    uint8_t *buffer = reinterpret_cast<uint8_t*>(malloc(geometry.bytes()));
+    if(! buffer)
+        throw bad_alloc();
+    return buffer;
+}
+
+void FramePool::release(uint8_t* buffer, const Frame::Geometry& geometry)
+{
+    if(! buffer)
+        return;
+    if(geometry.bytes() > 0) {
+        lock_guard<mutex> lock(d->spares_mutex);
+        auto &spares = d->spares[Private::key(geometry)];
+        if(spares.size() < d->max_spares_per_geometry) {
+            spares.push_back(buffer);
+            return;
+        }
+    }
+    free(buffer);
+}
+
+Frame::Geometry FramePool::published(const Frame::Geometry& geometry)
+{
+    lock_guard<mutex> lock(d->spares_mutex);
+    auto previous = d->published;
+    d->published = geometry;
+    return previous;
+}
+
+void FramePool::clear()
+{
+    lock_guard<mutex> lock(d->spares_mutex);
+    for(auto spares: d->spares)
+        for(auto buffer: spares.second)
+            free(buffer);
+    d->spares.clear();
+}
+
+FramePool::Stats FramePool::stats() const
+{
+    lock_guard<mutex> lock(d->spares_mutex);
+    Stats stats{d->hits, d->misses, 0, 0};
+    for(auto spares: d->spares) {
+        stats.spare_buffers += spares.second.size();
+        stats.spare_bytes += spares.second.size() * Frame::Geometry{get<0>(spares.first), get<1>(spares.first), get<2>(spares.first), get<3>(spares.first)}.bytes();
+    }
+    return stats;
+}
@@ -0,0 +1,59 @@
+/*
+ * Driver type: GPhoto Camera INDI Driver
+ *
+ * Copyright (C) 2016 Marco Gulino (marco AT gulinux.net)
+ *
+ * This library is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+#ifndef INDI_GPHOTO_FRAMEPOOL_H
+#define INDI_GPHOTO_FRAMEPOOL_H
+
+#include <memory>
+#include <cstdint>
+#include "frame.h"
+#include "c++/dptr.h"
+
+namespace INDI {
+namespace GPhoto {
+/**
+ * Keeps spare frame buffers between exposures, keyed by frame geometry and bit depth.
+ * A buffer is allocated only when no spare buffer with the same geometry is available, spares of other geometries being freed.
+ * Thread safe: buffers are acquired by the decoding worker and released from the INDI event loop.
+ */
+class FramePool
+{
+public:
+    typedef std::shared_ptr<FramePool> ptr;
+    struct Stats {
+        uint64_t hits;
+        uint64_t misses;
+        std::size_t spare_buffers;
+        std::size_t spare_bytes;
+    };
+    FramePool(std::size_t max_spares_per_geometry = 2);
+    ~FramePool();
+    uint8_t *acquire(const Frame::Geometry &geometry);
+    void release(uint8_t *buffer, const Frame::Geometry &geometry);
+    /// Records the geometry of the buffer now owned by the chip, returning the one previously published.
+    Frame::Geometry published(const Frame::Geometry &geometry);
+    void clear();
+    Stats stats() const;
+private:
+    D_PTR;
+};
+}
+}
+
+#endif // INDI_GPHOTO_FRAMEPOOL_H
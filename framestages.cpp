@@ -0,0 +1,131 @@
+/*
+ * Driver type: GPhoto Camera INDI Driver
+ *
+ * Copyright (C) 2016 Marco Gulino (marco AT gulinux.net)
+ *
+ * This library is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+#include "framestages.h"
+#include "statusnumbers.h"
+#include <deque>
+#include <vector>
+#include <numeric>
+#include <sstream>
+#include <cctype>
+
+using namespace std;
+using namespace INDI::GPhoto;
+
+namespace {
+const size_t AVERAGE_FRAMES = 10;
+}
+
+class FrameStages::Private {
+public:
+    Private(INDI::DefaultDevice *device, FrameStages *q);
+    struct Stage {
+        string name;
+        string label;
+        Camera::Seconds last;
+        deque<Camera::Seconds> history;
+        Camera::Seconds average() const {
+            return history.empty() ? Camera::Seconds{0} : accumulate(history.begin(), history.end(), Camera::Seconds{0}) / history.size();
+        }
+    };
+    vector<Stage> stages;
+    uint64_t frames = 0;
+    size_t bytes = 0;
+    double decode_rate = 0;
+    StatusNumbers property;
+    static string key(const Stage &stage);
+private:
+    FrameStages *q;
+};
+
+FrameStages::Private::Private(INDI::DefaultDevice* device, FrameStages* q)
+    : stages{
+        {"EXPOSURE", "Exposure"},
+        {"TRANSFER", "Transfer"},
+        {"DECODE", "Decode"},
+        {"WAIT", "Wait for driver"},
+        {"PUBLISH", "Buffer handover"},
+        {"UPLOAD", "Save and upload"},
+        {"TOTAL", "Total"},
+      },
+      property{device, "FRAME_STAGES", "Frame Stages (ms)", "Debug"}, q{q}
+{
+}
+
+FrameStages::FrameStages(INDI::DefaultDevice* device) : dptr(device, this)
+{
+    for(auto &stage: d->stages)
+        d->property.add("FRAME_STAGE_" + stage.name + "_LAST", stage.label + " last", "%.1f")
+            .add("FRAME_STAGE_" + stage.name + "_AVERAGE", stage.label + " average", "%.1f");
+    d->property.add("FRAME_STAGE_MEGABYTES", "Transferred (MB)", "%.2f").add("FRAME_STAGE_DECODE_RATE", "Decoding (MB/s)", "%.1f")
+        .add("FRAME_STAGE_FRAMES", "Frames");
+}
+
+FrameStages::~FrameStages()
+{
+}
+
+void FrameStages::define()
+{
+    d->property.define();
+}
+
+void FrameStages::remove()
+{
+    d->property.remove();
+}
+
+void FrameStages::add(const Camera::FrameTimings& timings, Camera::Seconds upload)
+{
+    const Camera::Seconds values[] = {timings.exposure, timings.download, timings.decode, timings.wait, timings.publish, upload, timings.total + timings.publish + upload};
+    for(size_t index = 0; index < d->stages.size(); index++) {
+        auto &stage = d->stages[index];
+        stage.last = values[index];
+        stage.history.push_back(stage.last);
+        if(stage.history.size() > AVERAGE_FRAMES)
+            stage.history.pop_front();
+        d->property.set("FRAME_STAGE_" + stage.name + "_LAST", stage.last.count() * 1000);
+        d->property.set("FRAME_STAGE_" + stage.name + "_AVERAGE", stage.average().count() * 1000);
+    }
+    d->frames++;
+    d->bytes = timings.bytes;
+    d->decode_rate = timings.decode.count() > 0 ? timings.bytes / 1e6 / timings.decode.count() : 0;
+    d->property.set("FRAME_STAGE_MEGABYTES", d->bytes / 1e6);
+    d->property.set("FRAME_STAGE_DECODE_RATE", d->decode_rate);
+    d->property.set("FRAME_STAGE_FRAMES", d->frames);
+    d->property.send();
+}
+
+string FrameStages::Private::key(const Stage& stage)
+{
+    string key = stage.name + "_ms";
+    for(auto &c: key)
+        c = tolower(c);
+    return key;
+}
+
+string FrameStages::json() const
+{
+    ostringstream out;
+    out << "{\"event\":\"frame\",\"frame\":" << d->frames;
+    for(auto &stage: d->stages)
+        out << ",\"" << Private::key(stage) << "\":" << stage.last.count() * 1000;
+    out << ",\"bytes\":" << d->bytes << ",\"decode_mb_per_s\":" << d->decode_rate << "}";
+    return out.str();
+}
@@ -0,0 +1,51 @@
+/*
+ * Driver type: GPhoto Camera INDI Driver
+ *
+ * Copyright (C) 2016 Marco Gulino (marco AT gulinux.net)
+ *
+ * This library is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+#ifndef INDI_GPHOTO_FRAMESTAGES_H
+#define INDI_GPHOTO_FRAMESTAGES_H
+
+#include <string>
+#include "camera.h"
+#include "c++/dptr.h"
+
+namespace INDI {
+namespace GPhoto {
+/**
+ * Time spent by each frame in every capture stage, published as the read only FRAME_STAGES property:
+ * last and average milliseconds over the last frames for each stage, with the transferred size and decoding throughput.
+ * Must be used from the INDI event loop only.
+ */
+class FrameStages
+{
+public:
+    FrameStages(INDI::DefaultDevice *device);
+    ~FrameStages();
+    void define();
+    void remove();
+    /// Records a published frame: `upload` is the time spent saving and sending it to the client
+    void add(const Camera::FrameTimings &timings, Camera::Seconds upload);
+    /// Last frame stages as a single line JSON object, for log based dashboards
+    std::string json() const;
+private:
+    D_PTR;
+};
+}
+}
+
+#endif // INDI_GPHOTO_FRAMESTAGES_H
@@ -0,0 +1,236 @@
+/*
+ * Driver type: GPhoto Camera INDI Driver
+ *
+ * Copyright (C) 2016 Marco Gulino (marco AT gulinux.net)
+ *
+ * This library is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+#include "framestatistics.h"
+#include <algorithm>
+#include <cmath>
+#include <mutex>
+
+using namespace std;
+using namespace INDI::GPhoto;
+
+namespace {
+// Stars are searched for one in each tile, measured in a window of this radius around their peak
+const int TILE = 32;
+const int STAR_RADIUS = 8;
+const size_t MAX_STAR_CANDIDATES = 500;
+// Peaks must be this many noise sigmas above the background
+const double DETECTION_SIGMAS = 8;
+
+int tiles(int pixels)
+{
+    return (pixels + TILE - 1) / TILE;
+}
+}
+
+FrameStatistics::Rows::Rows(const Frame::Geometry& geometry, bool stars)
+    : width{geometry.width}, peaks_channel{geometry.channels == 3 ? 1 : 0}, histogram(size_t{1} << geometry.bpp)
+{
+    if(stars)
+        peaks.resize(static_cast<size_t>(tiles(geometry.width)) * tiles(geometry.height), Peak{0, 0, 0});
+}
+
+template<typename T> void FrameStatistics::Rows::add(const T* row, int y, int channel)
+{
+    uint32_t *bins = histogram.data();
+    for(int x = 0; x < width; x++)
+        bins[row[x]]++;
+    if(peaks.empty() || channel != peaks_channel)
+        return;
+    Peak *tile_peaks = peaks.data() + static_cast<size_t>(y / TILE) * tiles(width);
+    for(int tile_x = 0; tile_x * TILE < width; tile_x++) {
+        const T *begin = row + tile_x * TILE, *end = row + min(width, (tile_x + 1) * TILE);
+        const T *brightest = max_element(begin, end);
+        Peak &peak = tile_peaks[tile_x];
+        if(*brightest > peak.value)
+            peak = {*brightest, static_cast<int>(brightest - row), y};
+    }
+}
+
+template void FrameStatistics::Rows::add<uint8_t>(const uint8_t *row, int y, int channel);
+template void FrameStatistics::Rows::add<uint16_t>(const uint16_t *row, int y, int channel);
+
+class FrameStatistics::Private {
+public:
+    Private(Mode mode, FrameStatistics *q);
+    Mode mode;
+    mutex merge_mutex;
+    vector<uint64_t> histogram;
+    vector<Rows::Peak> peaks;
+    Result result;
+    double percentile(double fraction, uint64_t samples) const;
+    void find_stars(const Frame &frame);
+private:
+    FrameStatistics *q;
+};
+
+FrameStatistics::Private::Private(Mode mode, FrameStatistics* q) : mode{mode}, q{q}
+{
+}
+
+FrameStatistics::FrameStatistics(Mode mode) : dptr(mode, this)
+{
+}
+
+FrameStatistics::~FrameStatistics()
+{
+}
+
+FrameStatistics::Mode FrameStatistics::mode() const
+{
+    return d->mode;
+}
+
+const FrameStatistics::Result& FrameStatistics::result() const
+{
+    return d->result;
+}
+
+unique_ptr<FrameStatistics::Rows> FrameStatistics::rows(const Frame::Geometry& geometry) const
+{
+    return unique_ptr<Rows>{new Rows{geometry, d->mode == Stars}};
+}
+
+void FrameStatistics::merge(const Rows& rows)
+{
+    lock_guard<mutex> lock(d->merge_mutex);
+    if(d->histogram.size() != rows.histogram.size())
+        d->histogram.assign(rows.histogram.size(), 0);
+    for(size_t value = 0; value < rows.histogram.size(); value++)
+        d->histogram[value] += rows.histogram[value];
+    if(d->peaks.size() != rows.peaks.size())
+        d->peaks.assign(rows.peaks.size(), Rows::Peak{0, 0, 0});
+    for(size_t tile = 0; tile < rows.peaks.size(); tile++)
+        if(rows.peaks[tile].value > d->peaks[tile].value)
+            d->peaks[tile] = rows.peaks[tile];
+}
+
+double FrameStatistics::Private::percentile(double fraction, uint64_t samples) const
+{
+    const uint64_t target = static_cast<uint64_t>(fraction * samples);
+    uint64_t count = 0;
+    for(size_t value = 0; value < histogram.size(); value++) {
+        count += histogram[value];
+        if(count > target)
+            return value;
+    }
+    return histogram.size() - 1;
+}
+
+void FrameStatistics::finish(const Frame& frame)
+{
+    Result &result = d->result;
+    result = {};
+    uint64_t samples = 0;
+    double sum = 0, squares_sum = 0;
+    result.histogram.assign(HISTOGRAM_BINS, 0);
+    for(size_t value = 0; value < d->histogram.size(); value++) {
+        const uint64_t count = d->histogram[value];
+        if(! count)
+            continue;
+        result.min = samples ? result.min : value;
+        result.max = value;
+        samples += count;
+        sum += static_cast<double>(value) * count;
+        squares_sum += static_cast<double>(value) * value * count;
+        result.histogram[value * HISTOGRAM_BINS / d->histogram.size()] += count;
+    }
+    if(! samples)
+        return;
+    result.valid = true;
+    result.mean = sum / samples;
+    result.stddev = sqrt(max(0., squares_sum / samples - result.mean * result.mean));
+    result.median = d->percentile(0.5, samples);
+    if(d->mode == Stars)
+        d->find_stars(frame);
+}
+
+void FrameStatistics::Private::find_stars(const Frame& frame)
+{
+    const auto &geometry = frame.geometry();
+    const int channel = geometry.channels == 3 ? 1 : 0;
+    auto pixel = [&](int x, int y) -> double {
+        const size_t index = static_cast<size_t>(y) * geometry.width + x;
+        return geometry.bpp == 8 ? frame.plane<uint8_t>(channel)[index] : frame.plane<uint16_t>(channel)[index];
+    };
+    // Background noise from the lower half of the histogram, which stars hardly reach
+    uint64_t samples = 0;
+    for(auto count: histogram)
+        samples += count;
+    const double background = result.median;
+    const double sigma = max(1., background - percentile(0.1587, samples));
+    const double threshold = background + DETECTION_SIGMAS * sigma;
+
+    vector<Rows::Peak> candidates;
+    copy_if(peaks.begin(), peaks.end(), back_inserter(candidates), [&](const Rows::Peak &peak) {
+        return peak.value > threshold && peak.x >= STAR_RADIUS && peak.y >= STAR_RADIUS
+            && peak.x + STAR_RADIUS < geometry.width && peak.y + STAR_RADIUS < geometry.height;
+    });
+    sort(candidates.begin(), candidates.end(), [](const Rows::Peak &a, const Rows::Peak &b) { return a.value > b.value; });
+    candidates.resize(min(candidates.size(), MAX_STAR_CANDIDATES));
+
+    vector<pair<double, double>> stars;
+    vector<double> radii;
+    for(auto &peak: candidates) {
+        // The same star may be the brightest pixel of neighbouring tiles
+        bool duplicate = any_of(stars.begin(), stars.end(), [&](const pair<double, double> &star) {
+            return abs(star.first - peak.x) <= STAR_RADIUS && abs(star.second - peak.y) <= STAR_RADIUS;
+        });
+        if(duplicate)
+            continue;
+        // Hot pixels stand alone: stars light up their neighbours too
+        int lit_neighbours = 0;
+        for(int y = peak.y - 1; y <= peak.y + 1; y++)
+            for(int x = peak.x - 1; x <= peak.x + 1; x++)
+                lit_neighbours += (x != peak.x || y != peak.y) && pixel(x, y) > background + 3 * sigma ? 1 : 0;
+        if(lit_neighbours < 2)
+            continue;
+        double flux = 0, center_x = 0, center_y = 0;
+        for(int y = peak.y - STAR_RADIUS; y <= peak.y + STAR_RADIUS; y++) {
+            for(int x = peak.x - STAR_RADIUS; x <= peak.x + STAR_RADIUS; x++) {
+                const double value = max(0., pixel(x, y) - background);
+                flux += value;
+                center_x += value * x;
+                center_y += value * y;
+            }
+        }
+        center_x /= flux;
+        center_y /= flux;
+        double weighted_radius = 0, window_flux = 0;
+        for(int y = peak.y - STAR_RADIUS; y <= peak.y + STAR_RADIUS; y++) {
+            for(int x = peak.x - STAR_RADIUS; x <= peak.x + STAR_RADIUS; x++) {
+                const double radius = hypot(x - center_x, y - center_y);
+                if(radius > STAR_RADIUS)
+                    continue;
+                const double value = max(0., pixel(x, y) - background);
+                weighted_radius += value * radius;
+                window_flux += value;
+            }
+        }
+        if(window_flux <= 0)
+            continue;
+        stars.push_back({center_x, center_y});
+        radii.push_back(weighted_radius / window_flux);
+    }
+    result.stars = stars.size();
+    if(radii.empty())
+        return;
+    nth_element(radii.begin(), radii.begin() + radii.size() / 2, radii.end());
+    result.hfr = radii[radii.size() / 2];
+}
@@ -0,0 +1,88 @@
+/*
+ * Driver type: GPhoto Camera INDI Driver
+ *
+ * Copyright (C) 2016 Marco Gulino (marco AT gulinux.net)
+ *
+ * This library is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+#ifndef INDI_GPHOTO_FRAMESTATISTICS_H
+#define INDI_GPHOTO_FRAMESTATISTICS_H
+
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include "frame.h"
+#include "c++/dptr.h"
+
+namespace INDI {
+namespace GPhoto {
+/**
+ * Statistics of a frame, accumulated by FrameWriter from each output row as it is written, while the row is still in cache.
+ * Minimum, maximum, mean, median and standard deviation come from a histogram with one bin per sample value, all channels together.
+ * Star detection keeps the brightest pixel of each tile during the same pass (on the green plane of color frames);
+ * once the frame is complete, only small windows around the peaks brighter than the background are read to measure
+ * the half flux radius. On undemosaiced (Bayer) frames the color filter array is not taken into account.
+ */
+class FrameStatistics
+{
+public:
+    typedef std::shared_ptr<FrameStatistics> ptr;
+    enum Mode { Off, Basic, Stars };
+    static const int HISTOGRAM_BINS = 256;
+    struct Result {
+        bool valid = false;
+        double min = 0;
+        double max = 0;
+        double mean = 0;
+        double median = 0;
+        double stddev = 0;
+        int stars = 0;
+        double hfr = 0; ///< median half flux radius of the detected stars, in output pixels
+        std::vector<uint64_t> histogram; ///< HISTOGRAM_BINS bins over the whole sample range
+    };
+    /// Statistics of some of the rows of a frame: each thread writing rows has its own, merged once done
+    class Rows {
+    public:
+        Rows(const Frame::Geometry &geometry, bool stars);
+        template<typename T> void add(const T *row, int y, int channel);
+    private:
+        friend class FrameStatistics;
+        struct Peak {
+            uint32_t value;
+            int x;
+            int y;
+        };
+        int width;
+        int peaks_channel;
+        std::vector<uint32_t> histogram;
+        std::vector<Peak> peaks; ///< brightest pixel of each tile, row by row
+    };
+
+    FrameStatistics(Mode mode);
+    ~FrameStatistics();
+    Mode mode() const;
+    std::unique_ptr<Rows> rows(const Frame::Geometry &geometry) const;
+    /// Adds the rows statistics: may be called by several threads
+    void merge(const Rows &rows);
+    /// Computes the result once the whole frame is written
+    void finish(const Frame &frame);
+    const Result &result() const;
+private:
+    D_PTR;
+};
+}
+}
+
+#endif // INDI_GPHOTO_FRAMESTATISTICS_H
@@ -0,0 +1,235 @@
+/*
+ * Driver type: GPhoto Camera INDI Driver
+ *
+ * Copyright (C) 2016 Marco Gulino (marco AT gulinux.net)
+ *
+ * This library is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+#include "framewriter.h"
+#include "pixelkernels.h"
+#include "parallel.h"
+#include "framestatistics.h"
+#include <memory>
+#include <vector>
+#include <limits>
+#include <algorithm>
+#include <stdexcept>
+
+using namespace std;
+using namespace INDI::GPhoto;
+
+class FrameWriter::Private {
+public:
+    Private(Frame &frame, FrameWriter *q);
+    Frame &frame;
+    Frame::Region region;
+    int channels;
+    int bpp;
+    Frame::Geometry output;
+    unique_ptr<Calibration::Rows> calibration;
+    // Binning: region rows are deinterleaved into `row_planes`, then added to `sums` until a whole row of bins is complete.
+    // Rows written in parallel use a set of buffers for each thread.
+    struct Bins {
+        vector<uint8_t> row_planes;
+        vector<uint32_t> sums;
+        int summed_rows = 0;
+        unique_ptr<FrameStatistics::Rows> statistics;
+    };
+    Bins bins;
+    Bins make_bins() const;
+    template<typename T> void write(int y, const T *row, int stride, Bins &bins);
+    template<typename T> void calibrate(int y, T * const *planes);
+    template<typename T> void add_statistics(int output_row, Bins &bins);
+    template<typename T> void write_bins(int output_row, Bins &bins);
+    template<typename T> void write_all(const T *image, size_t pitch, int stride);
+private:
+    FrameWriter *q;
+};
+
+FrameWriter::Private::Private(Frame& frame, FrameWriter* q) : frame{frame}, q{q}
+{
+}
+
+FrameWriter::FrameWriter(Frame& frame, const Frame::Region& region, int width, int height, int channels, int bpp) : dptr(frame, this)
+{
+    Frame::Region &clipped = d->region;
+    clipped = region;
+    clipped.bin_x = max(region.bin_x, 1);
+    clipped.bin_y = max(region.bin_y, 1);
+    if(region.whole()) {
+        clipped.x = clipped.y = 0;
+        clipped.width = width;
+        clipped.height = height;
+    } else {
+        clipped.x = min(max(region.x, 0), width - 1);
+        clipped.y = min(max(region.y, 0), height - 1);
+        clipped.width = min(region.width, width - clipped.x);
+        clipped.height = min(region.height, height - clipped.y);
+    }
+    clipped.width -= clipped.width % clipped.bin_x;
+    clipped.height -= clipped.height % clipped.bin_y;
+    if(clipped.width <= 0 || clipped.height <= 0)
+        throw runtime_error("Requested frame is smaller than the binning");
+    d->channels = channels;
+    d->bpp = bpp;
+    d->output = {clipped.width / clipped.bin_x, clipped.height / clipped.bin_y, channels, bpp == 8 && clipped.binned() && clipped.sum ? 16 : bpp};
+    frame.resize(d->output);
+    frame.set_region(clipped, width, height);
+    d->bins = d->make_bins();
+    if(frame.calibration()) {
+        d->calibration.reset(new Calibration::Rows{*frame.calibration(), width, height, channels});
+        if(! d->calibration->active())
+            d->calibration.reset();
+    }
+}
+
+FrameWriter::Private::Bins FrameWriter::Private::make_bins() const
+{
+    Bins bins;
+    if(region.binned()) {
+        bins.row_planes.resize(static_cast<size_t>(region.width) * channels * bpp / 8);
+        bins.sums.resize(static_cast<size_t>(region.width) * channels);
+    }
+    if(frame.statistics())
+        bins.statistics = frame.statistics()->rows(output);
+    return bins;
+}
+
+FrameWriter::~FrameWriter()
+{
+    if(! d->frame.statistics())
+        return;
+    d->frame.statistics()->merge(*d->bins.statistics);
+    d->frame.statistics()->finish(d->frame);
+}
+
+const Frame::Region& FrameWriter::region() const
+{
+    return d->region;
+}
+
+void FrameWriter::write_row(int y, const uint8_t* row)
+{
+    d->write(y, row, d->channels, d->bins);
+}
+
+void FrameWriter::write_row(int y, const uint16_t* row, int stride)
+{
+    d->write(y, row, stride, d->bins);
+}
+
+void FrameWriter::write_rows(const uint8_t* image, size_t pitch)
+{
+    d->write_all(image, pitch, d->channels);
+}
+
+void FrameWriter::write_rows(const uint16_t* image, size_t pitch, int stride)
+{
+    d->write_all(image, pitch, stride);
+}
+
+template<typename T> void FrameWriter::Private::write_all(const T* image, size_t pitch, int stride)
+{
+    // Each thread writes whole rows of bins, so no partial sums are shared
+    Parallel::for_rows(output.height, [&](int begin, int end) {
+        Bins thread_bins = make_bins();
+        for(int output_row = begin; output_row < end; output_row++) {
+            for(int bin_row = 0; bin_row < region.bin_y; bin_row++) {
+                const int y = region.y + output_row * region.bin_y + bin_row;
+                write(y, image + y * pitch, stride, thread_bins);
+            }
+        }
+        if(thread_bins.statistics)
+            frame.statistics()->merge(*thread_bins.statistics);
+    });
+}
+
+namespace {
+void deinterleave(const uint8_t *source, size_t pixels, int, int channels, uint8_t * const *planes)
+{
+    PixelKernels::deinterleave(source, pixels, channels, planes);
+}
+
+void deinterleave(const uint16_t *source, size_t pixels, int stride, int channels, uint16_t * const *planes)
+{
+    PixelKernels::deinterleave(source, pixels, stride, channels, planes);
+}
+}
+
+template<typename T> void FrameWriter::Private::write(int y, const T* row, int stride, Bins &bins)
+{
+    if(y < region.y || y >= region.y + region.height)
+        return;
+    const T *source = row + static_cast<size_t>(region.x) * stride;
+    const int output_row = (y - region.y) / region.bin_y;
+    T *planes[3];
+    if(! region.binned()) {
+        for(int channel = 0; channel < channels; channel++)
+            planes[channel] = frame.plane<T>(channel) + static_cast<size_t>(output_row) * output.width;
+        deinterleave(source, region.width, stride, channels, planes);
+        calibrate(y, planes);
+        add_statistics<T>(output_row, bins);
+        return;
+    }
+    for(int channel = 0; channel < channels; channel++)
+        planes[channel] = reinterpret_cast<T*>(bins.row_planes.data()) + static_cast<size_t>(channel) * region.width;
+    deinterleave(source, region.width, stride, channels, planes);
+    calibrate(y, planes);
+    for(int channel = 0; channel < channels; channel++)
+        PixelKernels::accumulate(planes[channel], region.width, bins.sums.data() + static_cast<size_t>(channel) * region.width);
+    if(++bins.summed_rows < region.bin_y)
+        return;
+    if(output.bpp == 8) {
+        write_bins<uint8_t>(output_row, bins);
+        add_statistics<uint8_t>(output_row, bins);
+    } else {
+        write_bins<uint16_t>(output_row, bins);
+        add_statistics<uint16_t>(output_row, bins);
+    }
+    fill(bins.sums.begin(), bins.sums.end(), 0);
+    bins.summed_rows = 0;
+}
+
+template<typename T> void FrameWriter::Private::calibrate(int y, T * const *planes)
+{
+    if(! calibration)
+        return;
+    for(int channel = 0; channel < channels; channel++)
+        PixelKernels::calibrate(planes[channel], region.width, calibration->offset(channel, y) + region.x, calibration->gain(channel, y) + region.x);
+}
+
+template<typename T> void FrameWriter::Private::add_statistics(int output_row, Bins &bins)
+{
+    if(! bins.statistics)
+        return;
+    for(int channel = 0; channel < channels; channel++)
+        bins.statistics->add(frame.plane<T>(channel) + static_cast<size_t>(output_row) * output.width, output_row, channel);
+}
+
+template<typename T> void FrameWriter::Private::write_bins(int output_row, Bins &bins)
+{
+    const uint32_t bin_pixels = region.bin_x * region.bin_y;
+    const uint32_t max_value = numeric_limits<T>::max();
+    for(int channel = 0; channel < channels; channel++) {
+        const uint32_t *column_sums = bins.sums.data() + static_cast<size_t>(channel) * region.width;
+        T *destination = frame.plane<T>(channel) + static_cast<size_t>(output_row) * output.width;
+        for(int x = 0; x < output.width; x++) {
+            uint32_t sum = 0;
+            for(int bin_column = 0; bin_column < region.bin_x; bin_column++)
+                sum += column_sums[x * region.bin_x + bin_column];
+            destination[x] = region.sum ? min(sum, max_value) : (sum + bin_pixels / 2) / bin_pixels;
+        }
+    }
+}
@@ -0,0 +1,58 @@
+/*
+ * Driver type: GPhoto Camera INDI Driver
+ *
+ * Copyright (C) 2016 Marco Gulino (marco AT gulinux.net)
+ *
+ * This library is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+#ifndef INDI_GPHOTO_FRAMEWRITER_H
+#define INDI_GPHOTO_FRAMEWRITER_H
+
+#include <cstdint>
+#include "frame.h"
+#include "c++/dptr.h"
+
+namespace INDI {
+namespace GPhoto {
+/**
+ * Copies decoded rows into a frame, cropping them to the requested region and binning them on the fly,
+ * so that pixels outside the region are never written and the frame is only as big as what is sent to the client.
+ * Rows are given top to bottom as interleaved pixels; rows outside the region are ignored.
+ * Binning averages the pixels (or sums them, saturating: 8 bit images are summed into a 16 bit frame).
+ * Images already decoded in memory can be written with write_rows(), splitting the rows across threads (see Parallel).
+ * When the frame has calibration masters of the image size, rows are calibrated as they are copied, before binning.
+ * When the frame has statistics, they are accumulated from the output rows, and computed when the writer is destroyed.
+ * The constructor resizes the frame, and throws std::runtime_error if the region is empty.
+ */
+class FrameWriter
+{
+public:
+    FrameWriter(Frame &frame, const Frame::Region &region, int width, int height, int channels, int bpp);
+    ~FrameWriter();
+    /// Region actually written: clipped to the image, width and height rounded down to whole bins
+    const Frame::Region &region() const;
+    void write_row(int y, const uint8_t *row);
+    /// `stride` is the number of 16 bit components for each pixel, at least the number of channels
+    void write_row(int y, const uint16_t *row, int stride);
+    /// Writes every region row of a whole image, `pitch` being the number of components from a row to the next one
+    void write_rows(const uint8_t *image, std::size_t pitch);
+    void write_rows(const uint16_t *image, std::size_t pitch, int stride);
+private:
+    D_PTR;
+};
+}
+}
+
+#endif // INDI_GPHOTO_FRAMEWRITER_H
@@ -1,38 +1,65 @@
 #include <sys/time.h>
 #include <memory>
+#include <map>
 
 #include "gphoto_ccd.h"
 #include "c++/containers_streams.h"
 #include "realcamera.h"
 #include "simulationcamera.h"
+#include "replaycamera.h"
+#include "parallel.h"
+#include <cstdlib>
 
 using namespace std;
 using namespace GuLinux;
 using namespace INDI::Properties;
 using namespace INDI::GPhoto;
 const int POLLMS           = 500;       /* Polling interval 500 ms */
+const int STREAM_POLLMS    = 10;        /* Polling interval while streaming live view */
 
 
-std::unique_ptr<GPhotoCCD> gphotoCCD(new GPhotoCCD());
+/**************************************************************************************
+** One INDI device for each camera attached, each opening the camera on its own port.
+** With a single camera (or none, for simulation) the device keeps the default name and autodetects the camera.
+***************************************************************************************/
+static vector<unique_ptr<GPhotoCCD>> &devices()
+{
+    static vector<unique_ptr<GPhotoCCD>> devices;
+    if(devices.empty()) {
+        auto detected = detect_cameras();
+        if(detected.size() <= 1)
+            devices.emplace_back(new GPhotoCCD{{}, "GPhoto NG CCD"});
+        for(size_t index = 0; detected.size() > 1 && index < detected.size(); index++)
+            devices.emplace_back(new GPhotoCCD{detected[index], index == 0 ? "GPhoto NG CCD" : "GPhoto NG CCD " + to_string(index + 1)});
+    }
+    return devices;
+}
+
+template<typename F> static void for_devices(const char *dev, F f)
+{
+    for(auto &device: devices())
+        if(! dev || string{dev} == device->getDeviceName())
+            f(*device);
+}
 
 void ISGetProperties(const char *dev)
 {
-    gphotoCCD->ISGetProperties(dev);
+    for_devices(dev, [=](GPhotoCCD &device) { device.ISGetProperties(dev); });
 }
 
 void ISNewSwitch(const char *dev, const char *name, ISState *states, char *names[], int num)
 {
-    gphotoCCD->ISNewSwitch(dev, name, states, names, num);
+    for_devices(dev, [=](GPhotoCCD &device) { device.ISNewSwitch(dev, name, states, names, num); });
 }
 
 void ISNewText(	const char *dev, const char *name, char *texts[], char *names[], int num)
 {
-    gphotoCCD->ISNewText(dev, name, texts, names, num);
+    for_devices(dev, [=](GPhotoCCD &device) { device.ISNewText(dev, name, texts, names, num); });
 }
 
 void ISNewNumber(const char *dev, const char *name, double values[], char *names[], int num)
 {
-    gphotoCCD->ISNewNumber(dev, name, values, names, num);
+    for_devices(dev, [=](GPhotoCCD &device) { device.ISNewNumber(dev, name, values, names, num); });
 }
 
 void ISNewBLOB (const char *dev, const char *name, int sizes[], int blobsizes[], char *blobs[], char *formats[], char *names[], int n)
@@ -49,11 +76,32 @@ void ISNewBLOB (const char *dev, const char *name, int sizes[], int blobsizes[],
 
 void ISSnoopDevice (XMLEle *root)
 {
-    gphotoCCD->ISSnoopDevice(root);
+    for_devices(nullptr, [=](GPhotoCCD &device) { device.ISSnoopDevice(root); });
 }
 
-GPhotoCCD::GPhotoCCD() : log {this, "GPhotoCCD"}
+GPhotoCCD::GPhotoCCD(const DetectedCamera &detected, const string &name) : detected{detected}, name{name}, log {this, "GPhotoCCD"}, burst_stats{this, "BURST_STATS", "Burst Statistics", "Main Control"},
+    frame_stages{this}, compression_stats{this, "FITS_TILE_COMPRESSION_STATS", "Tile Compression", "Image Settings"},
+    preview{this, "CCD_PREVIEW", "Preview", "Image Settings"},
+    live_view_stats{this, "LIVE_VIEW_STATS", "Live View", "Streaming"},
+    frame_statistics{this, "FRAME_STATISTICS", "Frame Statistics", "Statistics"},
+    frame_histogram{this, "FRAME_HISTOGRAM", "Histogram", "Statistics"},
+    live_stack_stats{this, "LIVE_STACK_STATS", "Live Stack", "Live Stack"}
 {
+    setDeviceName(name.c_str());
+    live_view_stats.add("LIVE_VIEW_FPS", "Camera frames per second", "%.1f").add("LIVE_VIEW_FRAMES", "Frames")
+        .add("LIVE_VIEW_SENT", "Frames sent").add("LIVE_VIEW_DROPPED", "Frames dropped");
+    burst_stats.add("BURST_FRAMES", "Frames").add("BURST_FRAME_TIME", "Last frame (s)", "%.3f")
+        .add("BURST_DOWNLOAD_TIME", "Last download (s)", "%.3f").add("BURST_DECODE_TIME", "Last decode (s)", "%.3f")
+        .add("BURST_FRAMES_PER_MINUTE", "Frames per minute", "%.2f");
+    compression_stats.add("TILE_COMPRESSION_RAW_MB", "Image (MB)", "%.2f").add("TILE_COMPRESSION_COMPRESSED_MB", "Compressed (MB)", "%.2f")
+        .add("TILE_COMPRESSION_RATIO", "Ratio", "%.2f").add("TILE_COMPRESSION_TIME", "Compression time (ms)", "%.0f");
+    frame_statistics.add("FRAME_STATISTICS_MIN", "Minimum").add("FRAME_STATISTICS_MAX", "Maximum")
+        .add("FRAME_STATISTICS_MEAN", "Mean", "%.1f").add("FRAME_STATISTICS_MEDIAN", "Median")
+        .add("FRAME_STATISTICS_STDDEV", "Standard deviation", "%.1f")
+        .add("FRAME_STATISTICS_STARS", "Stars").add("FRAME_STATISTICS_HFR", "Median HFR (pixels)", "%.2f");
+    for(int bin = 0; bin < FrameStatistics::HISTOGRAM_BINS; bin++)
+        frame_histogram.add("HISTOGRAM_" + to_string(bin), to_string(bin));
+    live_stack_stats.add("LIVE_STACK_FRAMES", "Stacked frames").add("LIVE_STACK_TIME", "Last frame stacking (ms)", "%.0f");
 }
 
 /**************************************************************************************
@@ -63,15 +111,22 @@ bool GPhotoCCD::Connect()
 {
     DEBUG(INDI::Logger::DBG_DEBUG, __PRETTY_FUNCTION__);
     try {
+        // Recorded camera files can be replayed instead of using a camera, to profile the driver on any machine
+        const char *replay_directory = getenv("INDI_GPHOTO_REPLAY");
 camera =  isSimulation() ? Camera::ptr {new SimulationCamera{this}} :
-        Camera::ptr {new RealCamera{this}};
+        replay_directory ? Camera::ptr {new ReplayCamera{this, replay_directory}} :
+        Camera::ptr {new RealCamera{this, detected}};
+        if(! frame_ready)
+            frame_ready.reset(new EventNotifier{bind(&GPhotoCCD::on_frame_ready, this)});
+        EventNotifier *notifier = frame_ready.get();
+        camera->set_frame_ready_callback([notifier]{ notifier->notify(); });
     } catch(std::exception &e) {
         log.error() << e.what();
         return false;
     }
     IDMessage(getDeviceName(), "Simple CCD connected successfully!");
 
-    // Let's set a timer that checks teleCCDs status every POLLMS milliseconds.
+    // Frames are published as soon as the camera notifies them, the timer only updates the exposure progress.
     SetTimer(POLLMS);
 
     return true;
@@ -83,10 +138,19 @@ camera =  isSimulation() ? Camera::ptr {new SimulationCamera{this}} :
 bool GPhotoCCD::Disconnect()
 {
     DEBUG(INDI::Logger::DBG_DEBUG, __PRETTY_FUNCTION__);
+    // A burst must not resume on the camera of the next connection
+    burst.to_shoot = 0;
+    live_stack.reset();
+    stack_pending = false;
     if(isSimulation())
         return true;
 
     camera.reset();
+    // Compressions still running would notify the event loop through frame_ready: tasks run in order, each one
+    // calling its notification before the next starts, so once an empty task is done none can use frame_ready anymore
+    compressor.queue<bool>([] { return true; }).wait();
+    compressing.clear();
+    frame_ready.reset();
     IDMessage(getDeviceName(), "Simple CCD disconnected successfully!");
     return true;
 }
@@ -96,7 +160,7 @@ bool GPhotoCCD::Disconnect()
 ***************************************************************************************/
 const char * GPhotoCCD::getDefaultName()
 {
-    return "GPhoto NG CCD";
+    return name.c_str();
 }
 
 /**************************************************************************************
@@ -108,10 +172,12 @@ bool GPhotoCCD::initProperties()
     INDI::CCD::initProperties();
     DEBUG(INDI::Logger::DBG_DEBUG, __PRETTY_FUNCTION__);
 
-    PrimaryCCD.setMinMaxStep("CCD_EXPOSURE", "CCD_EXPOSURE_VALUE", 0.001, 3600, 1, false);
-
     // We set the CCD capabilities
-    SetCCDCapability(CCD_HAS_SHUTTER);
+    SetCCDCapability(CCD_CAN_ABORT | CCD_HAS_SHUTTER | CCD_HAS_STREAMING | CCD_CAN_SUBFRAME | CCD_CAN_BIN);
+
+    PrimaryCCD.setMinMaxStep("CCD_EXPOSURE", "CCD_EXPOSURE_VALUE", 0.001, 3600, 1, false);
+    PrimaryCCD.setMinMaxStep("CCD_BINNING", "HOR_BIN", 1, 4, 1, false);
+    PrimaryCCD.setMinMaxStep("CCD_BINNING", "VER_BIN", 1, 4, 1, false);
 
     /* JM 2014-05-20 Make PrimaryCCD.ImagePixelSizeNP writable since we can't know for now the pixel size and bit depth from gphoto */
     PrimaryCCD.getCCDInfo()->p = IP_RW;
@@ -137,31 +203,30 @@ bool GPhotoCCD::updateProperties()
         // Dummy values for now
         SetCCDParams(1280, 1024, 8, 5.4, 5.4);
         try {
-            camera->setup_properties(properties[Device]);
-            properties[Device].add_switch("ISO", this, {getDeviceName(), "ISO", "ISO", "Image Settings"}, ISR_1OFMANY, [&](const vector<Switch::UpdateArgs> &states) {
-                auto on_switch = make_stream(states).first(Switch::On);
-                return on_switch && camera->set_iso(get<1>(*on_switch));
-            });
-
-            for(auto iso: camera->available_iso() )
-                properties[Device].switch_p("ISO").add(iso, iso, iso==camera->current_iso() ? ISS_ON : ISS_OFF);
-
-            properties[Device].add_switch("FORMAT", this, {getDeviceName(), "FORMAT", "FORMAT", "Image Settings"}, ISR_1OFMANY, [&](const vector<Switch::UpdateArgs> &states) {
-                auto on_switch = make_stream(states).first(Switch::On);
-                return on_switch && camera->set_format(get<1>(*on_switch));
-            });
-
-            for(auto iso: camera->available_formats() )
-                properties[Device].switch_p("FORMAT").add(iso, iso, iso==camera->current_format() ? ISS_ON : ISS_OFF);
-            // Start the timer
-            properties[Device].register_unregistered_properties();
+            define_camera_properties();
         } catch(std::exception &e) {
             log.error() << e.what();
             return false;
         }
+        burst_stats.define();
+        frame_stages.define();
+        compression_stats.define();
+        preview.define();
+        live_view_stats.define();
+        frame_statistics.define();
+        frame_histogram.define();
+        live_stack_stats.define();
         SetTimer(POLLMS);
     } else {
         properties.clear(GPhotoCCD::Device);
+        burst_stats.remove();
+        frame_stages.remove();
+        compression_stats.remove();
+        preview.remove();
+        live_view_stats.remove();
+        frame_statistics.remove();
+        frame_histogram.remove();
+        live_stack_stats.remove();
     }
 
     return true;
@@ -170,13 +235,234 @@ bool GPhotoCCD::updateProperties()
 
 
 
+/**************************************************************************************
+** Camera settings and capture options, defined again when the camera settings change
+***************************************************************************************/
+void GPhotoCCD::define_camera_properties()
+{
+    camera->set_decode_mode(decode_mode);
+    camera->set_decode_threads(decode_threads);
+    camera->setup_properties(properties[Device]);
+    properties[Device].add_switch("ISO", this, {getDeviceName(), "ISO", "ISO", "Image Settings"}, ISR_1OFMANY, [&](const vector<Switch::UpdateArgs> &states) {
+        auto on_switch = make_stream(states).first(Switch::On);
+        return on_switch && camera->set_iso(get<1>(*on_switch));
+    });
+
+    for(auto iso: camera->available_iso() )
+        properties[Device].switch_p("ISO").add(iso, iso, iso==camera->current_iso() ? ISS_ON : ISS_OFF);
+
+    properties[Device].add_switch("FORMAT", this, {getDeviceName(), "FORMAT", "FORMAT", "Image Settings"}, ISR_1OFMANY, [&](const vector<Switch::UpdateArgs> &states) {
+        auto on_switch = make_stream(states).first(Switch::On);
+        return on_switch && camera->set_format(get<1>(*on_switch));
+    });
+
+    for(auto iso: camera->available_formats() )
+        properties[Device].switch_p("FORMAT").add(iso, iso, iso==camera->current_format() ? ISS_ON : ISS_OFF);
+
+    static const map<string, ImageDecoder::Mode> decode_modes {
+        {"CAPTURE_FULL", ImageDecoder::FullImage}, {"CAPTURE_HALF_SIZE", ImageDecoder::HalfSize}, {"CAPTURE_PREVIEW", ImageDecoder::Preview},
+        {"CAPTURE_BAYER", ImageDecoder::Bayer}, {"CAPTURE_NATIVE", ImageDecoder::Native},
+    };
+    properties[Device].add_switch("CAPTURE_MODE", this, {getDeviceName(), "CAPTURE_MODE", "Capture Mode", "Image Settings"}, ISR_1OFMANY, [&](const vector<Switch::UpdateArgs> &states) {
+        auto on_switch = make_stream(states).first(Switch::On);
+        if(! on_switch)
+            return false;
+        decode_mode = decode_modes.at(get<1>(*on_switch));
+        camera->set_decode_mode(decode_mode);
+        return true;
+    })
+    .add("CAPTURE_FULL", "Full image", decode_mode == ImageDecoder::FullImage ? ISS_ON : ISS_OFF)
+    .add("CAPTURE_HALF_SIZE", "Half size", decode_mode == ImageDecoder::HalfSize ? ISS_ON : ISS_OFF)
+    .add("CAPTURE_PREVIEW", "Fast preview", decode_mode == ImageDecoder::Preview ? ISS_ON : ISS_OFF)
+    .add("CAPTURE_BAYER", "Raw Bayer (no debayering)", decode_mode == ImageDecoder::Bayer ? ISS_ON : ISS_OFF)
+    .add("CAPTURE_NATIVE", "Camera file (no decoding)", decode_mode == ImageDecoder::Native ? ISS_ON : ISS_OFF);
+
+    properties[Device].add_switch("CCD_BINNING_MODE", this, {getDeviceName(), "CCD_BINNING_MODE", "Binning Mode", "Image Settings"}, ISR_1OFMANY, [&](const vector<Switch::UpdateArgs> &states) {
+        auto on_switch = make_stream(states).first(Switch::On);
+        if(! on_switch)
+            return false;
+        region.sum = get<1>(*on_switch) == "BINNING_SUM";
+        return true;
+    })
+    .add("BINNING_AVERAGE", "Average", region.sum ? ISS_OFF : ISS_ON)
+    .add("BINNING_SUM", "Sum", region.sum ? ISS_ON : ISS_OFF);
+
+    properties[Device].add_switch("FRAME_STAGES_LOG", this, {getDeviceName(), "FRAME_STAGES_LOG", "Log Frame Stages", "Debug"}, ISR_1OFMANY, [&](const vector<Switch::UpdateArgs> &states) {
+        auto on_switch = make_stream(states).first(Switch::On);
+        if(! on_switch)
+            return false;
+        log_frame_stages = get<1>(*on_switch) == "FRAME_STAGES_LOG_ON";
+        return true;
+    })
+    .add("FRAME_STAGES_LOG_ON", "On", log_frame_stages ? ISS_ON : ISS_OFF)
+    .add("FRAME_STAGES_LOG_OFF", "Off", log_frame_stages ? ISS_OFF : ISS_ON);
+
+    static const map<string, FitsCompressor::Codec> codecs {
+        {"TILE_COMPRESSION_NONE", FitsCompressor::None}, {"TILE_COMPRESSION_RICE", FitsCompressor::Rice},
+        {"TILE_COMPRESSION_HCOMPRESS", FitsCompressor::HCompress}, {"TILE_COMPRESSION_GZIP", FitsCompressor::GZip},
+    };
+    properties[Device].add_switch("FITS_TILE_COMPRESSION", this, {getDeviceName(), "FITS_TILE_COMPRESSION", "Tile Compression", "Image Settings"}, ISR_1OFMANY, [&](const vector<Switch::UpdateArgs> &states) {
+        auto on_switch = make_stream(states).first(Switch::On);
+        if(! on_switch)
+            return false;
+        compression.codec = codecs.at(get<1>(*on_switch));
+        return true;
+    })
+    .add("TILE_COMPRESSION_NONE", "None", compression.codec == FitsCompressor::None ? ISS_ON : ISS_OFF)
+    .add("TILE_COMPRESSION_RICE", "Rice", compression.codec == FitsCompressor::Rice ? ISS_ON : ISS_OFF)
+    .add("TILE_COMPRESSION_HCOMPRESS", "HCOMPRESS", compression.codec == FitsCompressor::HCompress ? ISS_ON : ISS_OFF)
+    .add("TILE_COMPRESSION_GZIP", "GZIP", compression.codec == FitsCompressor::GZip ? ISS_ON : ISS_OFF);
+    properties[Device].add_number("FITS_TILE_COMPRESSION_LEVEL", this, {getDeviceName(), "FITS_TILE_COMPRESSION_LEVEL", "Compression Level", "Image Settings"}, [&](const vector<Number::UpdateArgs> &values) {
+        compression.level = get<0>(values[0]);
+        return true;
+    }).add("HCOMPRESS_SCALE", "HCOMPRESS scale (0: lossless)", 0, 16, 0.5, compression.level, "%.1f");
+    properties[Device].add_number("DECODE_THREADS", this, {getDeviceName(), "DECODE_THREADS", "Decode Threads", "Image Settings"}, [&](const vector<Number::UpdateArgs> &values) {
+        decode_threads = get<0>(values[0]);
+        camera->set_decode_threads(decode_threads);
+        return true;
+    }).add("DECODE_THREADS_COUNT", "Threads (0: all cores)", 0, 64, 1, decode_threads, "%.0f");
+
+    auto &burst_property = properties[Device].add_number("BURST", this, {getDeviceName(), "BURST", "Burst", "Main Control"}, [&](const vector<Number::UpdateArgs> &values) {
+        if(burst.to_shoot > 0 || camera->frames_in_flight() > 0)
+            return false;
+        for(auto value: values) {
+            if(get<1>(value) == "BURST_COUNT")
+                burst.count = get<0>(value);
+            if(get<1>(value) == "BURST_IN_FLIGHT")
+                burst.max_in_flight = get<0>(value);
+        }
+        return true;
+    });
+    burst_property.add("BURST_COUNT", "Frames per exposure", 1, 10000, 1, burst.count, "%.0f");
+    burst_property.add("BURST_IN_FLIGHT", "Max frames in flight", 1, 4, 1, burst.max_in_flight, "%.0f");
+
+    auto calibration_settings = calibration.settings();
+    properties[Device].add_switch("CALIBRATION", this, {getDeviceName(), "CALIBRATION", "Calibration", "Calibration"}, ISR_NOFMANY, [&](const vector<Switch::UpdateArgs> &states) {
+        auto settings = calibration.settings();
+        for(auto state: states) {
+            bool on = Switch::On(state);
+            settings.bias = get<1>(state) == "CALIBRATION_BIAS" ? on : settings.bias;
+            settings.dark = get<1>(state) == "CALIBRATION_DARK" ? on : settings.dark;
+            settings.flat = get<1>(state) == "CALIBRATION_FLAT" ? on : settings.flat;
+        }
+        set_calibration(settings);
+        return true;
+    })
+    .add("CALIBRATION_BIAS", "Bias", calibration_settings.bias ? ISS_ON : ISS_OFF)
+    .add("CALIBRATION_DARK", "Dark", calibration_settings.dark ? ISS_ON : ISS_OFF)
+    .add("CALIBRATION_FLAT", "Flat", calibration_settings.flat ? ISS_ON : ISS_OFF);
+    properties[Device].add_text("CALIBRATION_DIRECTORY", this, {getDeviceName(), "CALIBRATION_DIRECTORY", "Masters", "Calibration", IP_RW}, [&](const vector<Text::UpdateArgs> &values) {
+        auto settings = calibration.settings();
+        settings.directory = get<0>(values[0]);
+        set_calibration(settings);
+        return true;
+    }).add("CALIBRATION_DIRECTORY_PATH", "Directory", calibration_settings.directory);
+    properties[Device].add_number("CALIBRATION_MATCH", this, {getDeviceName(), "CALIBRATION_MATCH", "Masters Matching", "Calibration"}, [&](const vector<Number::UpdateArgs> &values) {
+        auto settings = calibration.settings();
+        for(auto value: values) {
+            if(get<1>(value) == "CALIBRATION_EXPOSURE_TOLERANCE")
+                settings.exposure_tolerance = get<0>(value) / 100;
+            if(get<1>(value) == "CALIBRATION_TEMPERATURE")
+                settings.temperature = get<0>(value);
+            if(get<1>(value) == "CALIBRATION_TEMPERATURE_TOLERANCE")
+                settings.temperature_tolerance = get<0>(value);
+        }
+        set_calibration(settings);
+        return true;
+    })
+    .add("CALIBRATION_EXPOSURE_TOLERANCE", "Dark exposure tolerance (%)", 0, 100, 1, calibration_settings.exposure_tolerance * 100, "%.0f")
+    .add("CALIBRATION_TEMPERATURE", "Sensor temperature (C)", -50, 50, 1, calibration_settings.temperature, "%.1f")
+    .add("CALIBRATION_TEMPERATURE_TOLERANCE", "Temperature tolerance (C, 0: any)", 0, 50, 1, calibration_settings.temperature_tolerance, "%.1f");
+
+    static const map<string, FrameStatistics::Mode> statistics_modes {
+        {"FRAME_STATISTICS_OFF", FrameStatistics::Off}, {"FRAME_STATISTICS_BASIC", FrameStatistics::Basic}, {"FRAME_STATISTICS_STARS", FrameStatistics::Stars},
+    };
+    properties[Device].add_switch("FRAME_STATISTICS_MODE", this, {getDeviceName(), "FRAME_STATISTICS_MODE", "Statistics", "Statistics"}, ISR_1OFMANY, [&](const vector<Switch::UpdateArgs> &states) {
+        auto on_switch = make_stream(states).first(Switch::On);
+        if(! on_switch)
+            return false;
+        statistics_mode = statistics_modes.at(get<1>(*on_switch));
+        return true;
+    })
+    .add("FRAME_STATISTICS_OFF", "Off", statistics_mode == FrameStatistics::Off ? ISS_ON : ISS_OFF)
+    .add("FRAME_STATISTICS_BASIC", "Histogram", statistics_mode == FrameStatistics::Basic ? ISS_ON : ISS_OFF)
+    .add("FRAME_STATISTICS_STARS", "Histogram and stars", statistics_mode == FrameStatistics::Stars ? ISS_ON : ISS_OFF);
+
+    static const map<string, LiveStack::Mode> stack_modes {
+        {"LIVE_STACK_OFF", LiveStack::Off}, {"LIVE_STACK_MEAN", LiveStack::Mean}, {"LIVE_STACK_SIGMA_CLIP", LiveStack::SigmaClip},
+    };
+    auto stack_settings = live_stack.settings();
+    properties[Device].add_switch("LIVE_STACK_MODE", this, {getDeviceName(), "LIVE_STACK_MODE", "Live Stack", "Live Stack"}, ISR_1OFMANY, [&](const vector<Switch::UpdateArgs> &states) {
+        auto on_switch = make_stream(states).first(Switch::On);
+        if(! on_switch || burst.to_shoot > 0 || camera->frames_in_flight() > 0)
+            return false;
+        auto settings = live_stack.settings();
+        settings.mode = stack_modes.at(get<1>(*on_switch));
+        live_stack.set_settings(settings);
+        return true;
+    })
+    .add("LIVE_STACK_OFF", "Off", stack_settings.mode == LiveStack::Off ? ISS_ON : ISS_OFF)
+    .add("LIVE_STACK_MEAN", "Mean", stack_settings.mode == LiveStack::Mean ? ISS_ON : ISS_OFF)
+    .add("LIVE_STACK_SIGMA_CLIP", "Sigma clipped mean", stack_settings.mode == LiveStack::SigmaClip ? ISS_ON : ISS_OFF);
+    properties[Device].add_number("LIVE_STACK_SETTINGS", this, {getDeviceName(), "LIVE_STACK_SETTINGS", "Stack Settings", "Live Stack"}, [&](const vector<Number::UpdateArgs> &values) {
+        auto settings = live_stack.settings();
+        for(auto value: values) {
+            if(get<1>(value) == "LIVE_STACK_PUBLISH_EVERY")
+                settings.publish_every = get<0>(value);
+            if(get<1>(value) == "LIVE_STACK_KAPPA")
+                settings.kappa = get<0>(value);
+        }
+        live_stack.set_settings(settings);
+        return true;
+    })
+    .add("LIVE_STACK_PUBLISH_EVERY", "Publish every (frames)", 1, 1000, 1, stack_settings.publish_every, "%.0f")
+    .add("LIVE_STACK_KAPPA", "Clipping (sigmas)", 1, 10, 0.5, stack_settings.kappa, "%.1f");
+    properties[Device].register_unregistered_properties();
+}
+
+void GPhotoCCD::refresh_camera_properties()
+{
+    log.debug() << "Camera settings changed, defining properties again";
+    properties.clear(Device);
+    try {
+        define_camera_properties();
+    } catch(std::exception &e) {
+        log.error() << e.what();
+    }
+}
+
+void GPhotoCCD::set_calibration(const Calibration::Settings& settings)
+{
+    try {
+        const bool rescan = settings.directory != calibration.settings().directory;
+        for(auto error: calibration.set_settings(settings))
+            log.warning() << "Skipping calibration master: " << error;
+        if(rescan && ! settings.directory.empty())
+            log.session() << "Calibration masters in " << settings.directory << ": " << calibration.summary();
+    } catch(std::exception &e) {
+        log.error() << e.what();
+    }
+}
+
+void GPhotoCCD::prepare_shot(float duration)
+{
+    auto masters = calibration.masters_for(camera->current_iso(), duration);
+    if(masters)
+        log.debug() << "Calibrating with " << masters->description();
+    camera->set_calibration(masters);
+    camera->set_statistics_mode(statistics_mode);
+}
+
 /**************************************************************************************
 ** Client is asking us to start an exposure
 ***************************************************************************************/
 bool GPhotoCCD::StartExposure(float duration)
 {
     try {
-        if(camera->shoot_status().status != Camera::ShootStatus::Idle || ! camera->shoot(Camera::Seconds {duration}))
+        if(burst.to_shoot > 0 || camera->shoot_status().status != Camera::ShootStatus::Idle)
+            return false;
+        prepare_shot(duration);
+        if(! camera->shoot(Camera::Seconds {duration}, region))
             return false;
         // Since we have only have one CCD with one chip, we set the exposure duration of the primary CCD
         PrimaryCCD.setExposureDuration(duration);
@@ -184,11 +470,145 @@ bool GPhotoCCD::StartExposure(float duration)
         log.error() << e.what();
         return false;
     }
+    burst.duration = duration;
+    burst.to_shoot = burst.count - 1;
+    burst.published = 0;
+    burst.started = burst.last_frame = chrono::steady_clock::now();
+    live_stack.reset();
+    stack_pending = false;
 
     // We're done
     return true;
 }
 
+/**************************************************************************************
+** Client is asking us to abort the exposure: the remaining burst frames are not taken, and the frames
+** not published yet are discarded
+***************************************************************************************/
+bool GPhotoCCD::AbortExposure()
+{
+    if(! camera)
+        return false;
+    if(burst.to_shoot > 0 || camera->frames_in_flight() > 0)
+        log.session() << "Exposure aborted, " << burst.to_shoot + camera->frames_in_flight() << " frames discarded";
+    burst.to_shoot = 0;
+    camera->abort();
+    live_stack.reset();
+    stack_pending = false;
+    burst_stats.send(IPS_IDLE);
+    return true;
+}
+
+/**************************************************************************************
+** Burst mode: next exposure starts as soon as the camera is done exposing the previous one,
+** while the previous frames are still being transferred and decoded.
+***************************************************************************************/
+void GPhotoCCD::shoot_next_burst_frame()
+{
+    if(burst.to_shoot <= 0 || ! camera->can_shoot() || camera->frames_in_flight() >= static_cast<size_t>(burst.max_in_flight))
+        return;
+    try {
+        prepare_shot(burst.duration);
+        if(camera->shoot(Camera::Seconds {burst.duration}, region)) {
+            burst.to_shoot--;
+            return;
+        }
+    } catch(std::exception &e) {
+        log.error() << e.what();
+    }
+    log.error() << "Burst interrupted, " << burst.to_shoot << " frames not taken";
+    burst.to_shoot = 0;
+}
+
+void GPhotoCCD::update_burst_stats()
+{
+    auto now = chrono::steady_clock::now();
+    auto timings = camera->last_frame_timings();
+    burst.published++;
+    burst_stats.set("BURST_FRAMES", burst.published);
+    burst_stats.set("BURST_FRAME_TIME", Camera::Seconds{now - burst.last_frame}.count());
+    burst_stats.set("BURST_DOWNLOAD_TIME", timings.download.count());
+    burst_stats.set("BURST_DECODE_TIME", timings.decode.count());
+    burst_stats.set("BURST_FRAMES_PER_MINUTE", burst.published / chrono::duration<double, ratio<60>>{now - burst.started}.count());
+    burst_stats.send(burst.to_shoot > 0 || camera->frames_in_flight() > 0 ? IPS_BUSY : IPS_OK);
+    burst.last_frame = now;
+}
+
+void GPhotoCCD::send_previews()
+{
+    for(auto frame_preview = camera->take_preview(); frame_preview; frame_preview = camera->take_preview())
+        preview.send(frame_preview->data.data(), frame_preview->data.size(), frame_preview->format);
+}
+
+/**************************************************************************************
+** Subframe and binning are applied by the decoder, so only the requested pixels are sent.
+** A subframe covering the whole sensor is recorded as the whole image, whatever its size turns out to be.
+***************************************************************************************/
+bool GPhotoCCD::UpdateCCDFrame(int x, int y, int w, int h)
+{
+    bool whole = x == 0 && y == 0 && w == PrimaryCCD.getXRes() && h == PrimaryCCD.getYRes();
+    region.x = whole ? 0 : x;
+    region.y = whole ? 0 : y;
+    region.width = whole ? 0 : w;
+    region.height = whole ? 0 : h;
+    return INDI::CCD::UpdateCCDFrame(x, y, w, h);
+}
+
+bool GPhotoCCD::UpdateCCDBin(int hor, int ver)
+{
+    region.bin_x = hor;
+    region.bin_y = ver;
+    return INDI::CCD::UpdateCCDBin(hor, ver);
+}
+
+/**************************************************************************************
+** Live view: frames are sent as a video stream, dropping the ones we could not send in time
+***************************************************************************************/
+bool GPhotoCCD::StartStreaming()
+{
+    try {
+        if(camera->frames_in_flight() > 0 || ! camera->start_live_view())
+            return false;
+    } catch(std::exception &e) {
+        log.error() << e.what();
+        return false;
+    }
+    streaming = true;
+    live_view_sent = 0;
+    return true;
+}
+
+bool GPhotoCCD::StopStreaming()
+{
+    streaming = false;
+    camera->stop_live_view();
+    return true;
+}
+
+void GPhotoCCD::send_live_view_frame()
+{
+    Frame::ptr frame;
+    try {
+        frame = camera->live_view_frame();
+    } catch(std::exception &e) {
+        log.error() << e.what();
+        StopStreaming();
+        return;
+    }
+    if(! frame)
+        return;
+    frame->publish(PrimaryCCD);
+    PrimaryCCD.setImageExtension("stream");
+    ExposureComplete(&PrimaryCCD);
+    auto stats = camera->live_view_stats();
+    live_view_sent++;
+    live_view_stats.set("LIVE_VIEW_FPS", stats.frames_per_second);
+    live_view_stats.set("LIVE_VIEW_FRAMES", stats.frames);
+    live_view_stats.set("LIVE_VIEW_SENT", live_view_sent);
+    live_view_stats.set("LIVE_VIEW_DROPPED", stats.dropped);
+    live_view_stats.send(IPS_BUSY);
+}
+
 /**************************************************************************************
 ** Main device loop. We check for exposure and temperature progress here
 ***************************************************************************************/
@@ -197,24 +617,196 @@ void GPhotoCCD::TimerHit()
     if(isConnected() == false)
         return;  //  No need to reset timer if we are not connected anymore
 
+    if(streaming) {
+        send_live_view_frame();
+        SetTimer(STREAM_POLLMS);
+        return;
+    }
+    if(camera->settings_changed() && burst.to_shoot <= 0 && camera->frames_in_flight() == 0)
+        refresh_camera_properties();
+    // Frames are normally published as soon as the worker notifies them; polling here is only a safety net
+    on_frame_ready();
     auto shoot_status = camera->shoot_status();
-    if (shoot_status.status == Camera::ShootStatus::Idle)
-        PrimaryCCD.setExposureLeft(camera->shoot_status().remaining.count());
-    if (shoot_status.status == Camera::ShootStatus::Finished) {
+    if (shoot_status.status == Camera::ShootStatus::Running)
+        PrimaryCCD.setExposureLeft(shoot_status.remaining.count());
+    if (shoot_status.status == Camera::ShootStatus::Downloading && last_shoot_status != Camera::ShootStatus::Downloading) {
         IDMessage(getDeviceName(), "Exposure done, downloading image...");
         // Set exposure left to zero
         PrimaryCCD.setExposureLeft(0);
+    }
+    last_shoot_status = shoot_status.status;
+    SetTimer(POLLMS);
+    return;
+}
+
+/**************************************************************************************
+** Called by the event loop as soon as the camera has news (exposure done, preview or image ready)
+***************************************************************************************/
+void GPhotoCCD::on_frame_ready()
+{
+    if(! isConnected() || ! camera || streaming)
+        return;
+    // The event loop is shared by all the devices: stacking and copying the frames use the threads of this one
+    Parallel::set_threads(decode_threads);
+    shoot_next_burst_frame();
+    send_previews();
+    publish_finished_frames();
+    publish_pending_stack();
+    publish_compressed_frames();
+}
+
+void GPhotoCCD::publish_finished_frames()
+{
+    while(camera->shoot_status().status == Camera::ShootStatus::Finished) {
+        PrimaryCCD.setExposureLeft(0);
         if(camera->write_image()(PrimaryCCD)) {
             IDMessage(getDeviceName(), "Download complete.");
-            ExposureComplete(&PrimaryCCD);
+            send_frame_statistics();
+            if(stack_frame())
+                publish_frame();
+            else
+                update_burst_stats();
         }
         else {
             DEBUG(INDI::Logger::DBG_ERROR, "Image download failed.");
             PrimaryCCD.setExposureFailed();
         }
+        shoot_next_burst_frame();
+    }
+}
+
+/**************************************************************************************
+** Stacking runs on the event loop, on all cores: it takes about as long as copying the frame into the chip buffer.
+** If stacking fails, the frame is published as it is.
+***************************************************************************************/
+bool GPhotoCCD::stack_frame()
+{
+    published_stack_frames = 0;
+    stack_pending = false;
+    if(live_stack.settings().mode == LiveStack::Off || string{PrimaryCCD.getImageExtension()} != "fits")
+        return true;
+    auto started = chrono::steady_clock::now();
+    bool publish = true;
+    try {
+        live_stack.add(PrimaryCCD);
+        const bool burst_done = burst.to_shoot == 0 && camera->frames_in_flight() == 0;
+        publish = burst_done || live_stack.frames() % live_stack.settings().publish_every == 0;
+        if(publish) {
+            live_stack.write(PrimaryCCD);
+            published_stack_frames = live_stack.frames();
+        }
+        stack_pending = ! publish;
+        live_stack_stats.set("LIVE_STACK_FRAMES", live_stack.frames());
+        live_stack_stats.set("LIVE_STACK_TIME", chrono::duration<double, milli>{chrono::steady_clock::now() - started}.count());
+        live_stack_stats.send(burst_done ? IPS_OK : IPS_BUSY);
+    } catch(std::exception &e) {
+        log.error() << e.what();
+        live_stack.reset();
+        publish = true;
+    }
+    return publish;
+}
+
+void GPhotoCCD::publish_pending_stack()
+{
+    if(! stack_pending || burst.to_shoot > 0 || camera->frames_in_flight() > 0)
+        return;
+    stack_pending = false;
+    try {
+        // The chip buffer still holds the last stacked frame, unless a later download failed
+        live_stack.write(PrimaryCCD);
+    } catch(std::exception &e) {
+        log.error() << e.what();
+        PrimaryCCD.setExposureFailed();
+        return;
+    }
+    published_stack_frames = live_stack.frames();
+    live_stack_stats.set("LIVE_STACK_FRAMES", live_stack.frames());
+    live_stack_stats.send(IPS_OK);
+    publish_frame(false);
+}
+
+void GPhotoCCD::send_frame_statistics()
+{
+    auto statistics = camera->last_frame_statistics();
+    if(! statistics.valid)
+        return;
+    frame_statistics.set("FRAME_STATISTICS_MIN", statistics.min);
+    frame_statistics.set("FRAME_STATISTICS_MAX", statistics.max);
+    frame_statistics.set("FRAME_STATISTICS_MEAN", statistics.mean);
+    frame_statistics.set("FRAME_STATISTICS_MEDIAN", statistics.median);
+    frame_statistics.set("FRAME_STATISTICS_STDDEV", statistics.stddev);
+    frame_statistics.set("FRAME_STATISTICS_STARS", statistics.stars);
+    frame_statistics.set("FRAME_STATISTICS_HFR", statistics.hfr);
+    frame_statistics.send();
+    for(int bin = 0; bin < FrameStatistics::HISTOGRAM_BINS; bin++)
+        frame_histogram.set("HISTOGRAM_" + to_string(bin), statistics.histogram[bin]);
+    frame_histogram.send();
+}
+
+void GPhotoCCD::publish_frame(bool new_frame)
+{
+    if(compression.codec != FitsCompressor::None && string{PrimaryCCD.getImageExtension()} == "fits")
+        compress_frame(new_frame);
+    else
+        complete_frame(camera->last_frame_timings(), new_frame);
+}
+
+void GPhotoCCD::complete_frame(const Camera::FrameTimings &timings, bool new_frame)
+{
+    auto upload_started = chrono::steady_clock::now();
+    ExposureComplete(&PrimaryCCD);
+    frame_stages.add(timings, chrono::steady_clock::now() - upload_started);
+    if(log_frame_stages)
+        log.session() << "frame_stages " << frame_stages.json();
+    if(new_frame)
+        update_burst_stats();
+}
+
+/**************************************************************************************
+** The image and its FITS keywords are copied from the chip, so that the next frame can be published meanwhile.
+** If the copy fails, the frame is sent uncompressed.
+***************************************************************************************/
+void GPhotoCCD::compress_frame(bool new_frame)
+{
+    shared_ptr<FitsCompressor::Image> image;
+    try {
+        image = make_shared<FitsCompressor::Image>(FitsCompressor::capture(PrimaryCCD, [this](fitsfile *fptr) { addFITSKeywords(fptr, &PrimaryCCD); }));
+    } catch(std::exception &e) {
+        log.error() << e.what();
+        complete_frame(camera->last_frame_timings(), new_frame);
+        return;
+    }
+    auto settings = compression;
+    EventNotifier *notifier = frame_ready.get();
+    compressing.push_back({
+        compressor.queue<FitsCompressor::Result>([image, settings] { return FitsCompressor::compress(*image, settings); }, [notifier] { notifier->notify(); }),
+        camera->last_frame_timings(),
+        new_frame,
+    });
+}
+
+void GPhotoCCD::publish_compressed_frames()
+{
+    while(! compressing.empty() && compressing.front().result.wait_for(chrono::seconds{0}) == future_status::ready) {
+        auto frame = move(compressing.front());
+        compressing.pop_front();
+        FitsCompressor::Result result;
+        try {
+            result = frame.result.get();
+        } catch(std::exception &e) {
+            log.error() << e.what();
+            PrimaryCCD.setExposureFailed();
+            continue;
+        }
+        compression_stats.set("TILE_COMPRESSION_RAW_MB", result.raw_bytes / 1e6);
+        compression_stats.set("TILE_COMPRESSION_COMPRESSED_MB", result.file.size() / 1e6);
+        compression_stats.set("TILE_COMPRESSION_RATIO", static_cast<double>(result.raw_bytes) / result.file.size());
+        compression_stats.set("TILE_COMPRESSION_TIME", result.elapsed.count() * 1000);
+        compression_stats.send();
+        Frame::publish_file(PrimaryCCD, result.file.data(), result.file.size(), "fits.fz");
+        complete_frame(frame.timings, frame.new_frame);
     }
-    SetTimer(POLLMS);
-    return;
 }
 
 
@@ -265,3 +857,22 @@ bool GPhotoCCD::saveConfigItems(FILE* fp)
     INDI::CCD::saveConfigItems(fp);
     return true;
 }
+
+void GPhotoCCD::addFITSKeywords(fitsfile* fptr, CCDChip* targetChip)
+{
+    INDI::CCD::addFITSKeywords(fptr, targetChip);
+    int status = 0;
+    // Lets frames taken with this driver be used as calibration masters
+    string iso = camera ? camera->current_iso() : string{};
+    if(! iso.empty())
+        fits_update_key_str(fptr, "ISOSPEED", iso.c_str(), "ISO speed", &status);
+    if(published_stack_frames > 0)
+        fits_update_key(fptr, TINT, "STACKCNT", &published_stack_frames, "Number of stacked frames", &status);
+    string bayer_pattern = camera ? camera->bayer_pattern() : string{};
+    if(bayer_pattern.empty())
+        return;
+    int offset = 0;
+    fits_update_key_str(fptr, "BAYERPAT", bayer_pattern.c_str(), "Bayer color pattern", &status);
+    fits_update_key(fptr, TINT, "XBAYROFF", &offset, "X offset of Bayer array", &status);
+    fits_update_key(fptr, TINT, "YBAYROFF", &offset, "Y offset of Bayer array", &status);
+}
@@ -6,13 +6,25 @@
 #include "indi_properties_map.h"
 #include <logger.h>
 #include "camera.h"
+#include "statusnumbers.h"
+#include "blobproperty.h"
+#include "eventnotifier.h"
+#include "framestages.h"
+#include "detectedcameras.h"
+#include "fitscompressor.h"
+#include "calibration.h"
+#include "livestack.h"
+#include "worker.h"
+#include <chrono>
+#include <deque>
+#include <future>
 
 namespace INDI {
 namespace GPhoto {
 class GPhotoCCD : public INDI::CCD
 {
 public:
-    GPhotoCCD();
+    GPhotoCCD(const DetectedCamera &detected, const std::string &name);
     
     virtual bool ISNewSwitch(const char* dev, const char* name, ISState* states, char* names[], int n);
     virtual bool ISNewBLOB(const char* dev, const char* name, int sizes[], int blobsizes[], char* blobs[], char* formats[], char* names[], int n);
@@ -28,17 +40,92 @@ protected:
 
     // CCD specific functions
     bool StartExposure(float duration);
+    bool AbortExposure();
     void TimerHit();
+    virtual bool StartStreaming();
+    virtual bool StopStreaming();
+    virtual bool UpdateCCDFrame(int x, int y, int w, int h);
+    virtual bool UpdateCCDBin(int hor, int ver);
     virtual bool saveConfigItems(FILE* fp);
+    virtual void addFITSKeywords(fitsfile *fptr, CCDChip *targetChip);
 
 private:
     enum PropertiesType { Persistent = 0, Device = 1 };
+    const DetectedCamera detected;
+    const std::string name;
     INDI::Properties::PropertiesMap<PropertiesType> properties;
+    // Declared before the camera, so that it outlives the camera worker thread notifying it
+    std::unique_ptr<EventNotifier> frame_ready;
     Camera::ptr camera;
     INDI::Utils::Logger log;
     // Utility functions
 
     int   timerID;
+    Camera::ShootStatus::Status last_shoot_status = Camera::ShootStatus::Idle;
+
+    struct Burst {
+        int count = 1;
+        int max_in_flight = 2;
+        float duration = 0;
+        int to_shoot = 0;
+        int published = 0;
+        std::chrono::steady_clock::time_point started;
+        std::chrono::steady_clock::time_point last_frame;
+    };
+    Burst burst;
+    StatusNumbers burst_stats;
+    void shoot_next_burst_frame();
+    Calibration calibration;
+    void set_calibration(const Calibration::Settings &settings);
+    /// Selects the calibration masters and statistics for the next shot, before starting it
+    void prepare_shot(float duration);
+    void update_burst_stats();
+    FrameStages frame_stages;
+    bool log_frame_stages = false;
+    /// `new_frame` is false when publishing again a frame already counted in the burst statistics
+    void complete_frame(const Camera::FrameTimings &timings, bool new_frame = true);
+    void publish_frame(bool new_frame = true);
+    /// Tile compression runs on its own worker, frames are completed once compressed
+    FitsCompressor::Settings compression{FitsCompressor::None, 0};
+    struct CompressingFrame {
+        std::future<FitsCompressor::Result> result;
+        Camera::FrameTimings timings;
+        bool new_frame;
+    };
+    std::deque<CompressingFrame> compressing;
+    Worker compressor;
+    StatusNumbers compression_stats;
+    void compress_frame(bool new_frame);
+    void publish_compressed_frames();
+    BlobProperty preview;
+    void send_previews();
+    void on_frame_ready();
+    void publish_finished_frames();
+    bool streaming = false;
+    uint64_t live_view_sent = 0;
+    StatusNumbers live_view_stats;
+    void send_live_view_frame();
+    /// Subframe and binning requested by the client, applied to each image while decoding it
+    Frame::Region region;
+    ImageDecoder::Mode decode_mode = ImageDecoder::FullImage;
+    /// Threads this device decodes, stacks and copies its frames with, 0 meaning one for each core
+    int decode_threads = 0;
+    /// Published for every decoded frame before the image itself, so that focusing clients can skip the image
+    FrameStatistics::Mode statistics_mode = FrameStatistics::Basic;
+    StatusNumbers frame_statistics;
+    StatusNumbers frame_histogram;
+    void send_frame_statistics();
+    /// Burst frames are added to the live stack, which replaces the frame to publish every few frames and at the end of the burst
+    LiveStack live_stack;
+    StatusNumbers live_stack_stats;
+    int published_stack_frames = 0;
+    bool stack_pending = false; ///< frames were stacked since the stack was last published
+    /// Returns false when the frame in the chip buffer was only stacked, and must not be published
+    bool stack_frame();
+    /// Publishes the stack when the burst ended (possibly interrupted) after stacking frames without publishing them
+    void publish_pending_stack();
+    void define_camera_properties();
+    void refresh_camera_properties();
 
 };
 }
@@ -0,0 +1,218 @@
+/*
+ * Driver type: GPhoto Camera INDI Driver
+ *
+ * Copyright (C) 2016 Marco Gulino (marco AT gulinux.net)
+ *
+ * This library is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+#include "imagedecoder.h"
+#include "framewriter.h"
+#include "parallel.h"
+#include <stdexcept>
+#include <algorithm>
+#include <csetjmp>
+#include <cstdio>
+#include <jpeglib.h>
+#include <libraw.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+using namespace std;
+using namespace INDI::GPhoto;
+
+string ImageDecoder::extension(const string& filename)
+{
+    string extension = filename.substr(filename.rfind(".") + 1);
+    transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+    return extension;
+}
+
+ImageDecoder::ptr ImageDecoder::for_file(const string& filename, Mode mode)
+{
+    string extension = ImageDecoder::extension(filename);
+    if(extension == "jpg" || extension == "jpeg")
+        return make_shared<JPEGDecoder>(mode);
+    return make_shared<RawDecoder>(mode);
+}
+
+namespace {
+struct JPEGErrorManager {
+    jpeg_error_mgr manager;
+    jmp_buf jump_buffer;
+    char message[JMSG_LENGTH_MAX];
+    static void error_exit(j_common_ptr cinfo) {
+        JPEGErrorManager *error_manager = reinterpret_cast<JPEGErrorManager*>(cinfo->err);
+        (*cinfo->err->format_message)(cinfo, error_manager->message);
+        longjmp(error_manager->jump_buffer, 1);
+    }
+};
+
+/**
+ * Runs libjpeg calls, returning false when libjpeg reports an error.
+ * error_exit jumps back here, skipping destructors: neither this function nor `calls` may have locals with one.
+ */
+template<typename Calls> bool jpeg_try(JPEGErrorManager &error_manager, const Calls &calls)
+{
+    if(setjmp(error_manager.jump_buffer))
+        return false;
+    calls();
+    return true;
+}
+}
+
+void JPEGDecoder::decode(const uint8_t* data, size_t size, Frame& frame, const Frame::Region &region)
+{
+    jpeg_decompress_struct cinfo;
+    JPEGErrorManager error_manager;
+    cinfo.err = jpeg_std_error(&error_manager.manager);
+    error_manager.manager.error_exit = JPEGErrorManager::error_exit;
+    auto fail = [&](const string &message) {
+        jpeg_destroy_decompress(&cinfo);
+        throw runtime_error(message);
+    };
+    auto jpeg_error = [&] { fail(string{"Error decoding JPEG image: "} + error_manager.message); };
+    if(! jpeg_try(error_manager, [&] {
+        jpeg_create_decompress(&cinfo);
+        jpeg_mem_src(&cinfo, const_cast<uint8_t*>(data), size);
+        jpeg_read_header(&cinfo, TRUE);
+    }))
+        jpeg_error();
+    if(cinfo.num_components != 1 && cinfo.num_components != 3)
+        fail("Unsupported JPEG color space");
+    cinfo.out_color_space = cinfo.num_components == 1 ? JCS_GRAYSCALE : JCS_RGB;
+    // libjpeg can scale while decoding the DCT blocks, skipping most of the work for reduced images
+    if(mode == HalfSize || mode == Preview) {
+        cinfo.scale_num = 1;
+        cinfo.scale_denom = mode == HalfSize ? 2 : 4;
+        cinfo.dct_method = mode == HalfSize ? JDCT_ISLOW : JDCT_IFAST;
+    }
+    // Only one scanline is buffered: pixels are deinterleaved from it directly into the frame planes.
+    JSAMPARRAY scanline = nullptr;
+    if(! jpeg_try(error_manager, [&] {
+        jpeg_start_decompress(&cinfo);
+        scanline = (*cinfo.mem->alloc_sarray)(reinterpret_cast<j_common_ptr>(&cinfo), JPOOL_IMAGE, cinfo.output_width * cinfo.output_components, 1);
+    }))
+        jpeg_error();
+    unique_ptr<FrameWriter> writer;
+    try {
+        writer.reset(new FrameWriter{frame, region, static_cast<int>(cinfo.output_width), static_cast<int>(cinfo.output_height), cinfo.output_components, 8});
+    } catch(std::exception &) {
+        jpeg_destroy_decompress(&cinfo);
+        throw;
+    }
+    // Scanlines below the region are not decoded at all.
+    const JDIMENSION end_row = writer->region().y + writer->region().height;
+    while(cinfo.output_scanline < end_row) {
+        int row = cinfo.output_scanline;
+        if(! jpeg_try(error_manager, [&] { jpeg_read_scanlines(&cinfo, scanline, 1); }))
+            jpeg_error();
+        writer->write_row(row, scanline[0]);
+    }
+    jpeg_abort_decompress(&cinfo);
+    jpeg_destroy_decompress(&cinfo);
+}
+
+vector<uint8_t> JPEGDecoder::jpeg_preview(const uint8_t* data, size_t size)
+{
+    return {data, data + size};
+}
+
+namespace {
+void check_libraw(int result, const string &operation) {
+    if(result != LIBRAW_SUCCESS)
+        throw runtime_error("Error decoding RAW image (" + operation + "): " + libraw_strerror(result));
+}
+}
+
+void RawDecoder::decode(const uint8_t* data, size_t size, Frame& frame, const Frame::Region &region)
+{
+    // LibRaw is a big object, better keep it away from the worker thread stack
+    unique_ptr<LibRaw> raw{new LibRaw};
+    raw->imgdata.params.output_bps = 16;
+    raw->imgdata.params.gamm[0] = raw->imgdata.params.gamm[1] = 1;
+    raw->imgdata.params.no_auto_bright = 1;
+    raw->imgdata.params.half_size = mode == HalfSize || mode == Preview ? 1 : 0;
+#ifdef _OPENMP
+    // LibRaw built with OpenMP parallelizes demosaicing and its other processing stages
+    omp_set_num_threads(Parallel::threads());
+#endif
+    check_libraw(raw->open_buffer(const_cast<uint8_t*>(data), size), "open");
+    if(mode == Preview && decode_thumbnail(*raw, frame, region))
+        return;
+    check_libraw(raw->unpack(), "unpack");
+    if(mode == Bayer && decode_bayer(*raw, frame, region))
+        return;
+    check_libraw(raw->dcraw_process(), "process");
+    const auto &sizes = raw->imgdata.sizes;
+    FrameWriter writer{frame, region, sizes.iwidth, sizes.iheight, 3, 16};
+    // LibRaw keeps processed pixels as interleaved 4 components: write them directly in the frame planes.
+    writer.write_rows(raw->imgdata.image[0], static_cast<size_t>(sizes.iwidth) * 4, 4);
+}
+
+bool RawDecoder::decode_bayer(LibRaw& raw, Frame& frame, const Frame::Region &region)
+{
+    const auto &sizes = raw.imgdata.sizes;
+    const uint16_t *raw_image = raw.imgdata.rawdata.raw_image;
+    // Non Bayer sensors (Foveon, 4 colors, linear DNG) have no single plane color filter array.
+    // LibRaw describes the color filter array of 8 rows by 2 columns in `filters` (values below 1000 are special
+    // arrays, i.e. 9 for X-Trans 6x6): only a pattern repeating every 2 rows can be published as BAYERPAT.
+    const unsigned filters = raw.imgdata.idata.filters;
+    if(! raw_image || filters < 1000 || filters != (filters & 0xff) * 0x01010101u)
+        return false;
+    auto pattern_at = [&raw](int y, int x) {
+        string pattern;
+        for(auto position: {make_pair(0, 0), make_pair(0, 1), make_pair(1, 0), make_pair(1, 1)})
+            pattern += raw.imgdata.idata.cdesc[raw.COLOR(y + position.first, x + position.second)];
+        return pattern;
+    };
+    if(pattern_at(0, 0).find_first_not_of("RGB") != string::npos)
+        return false;
+    FrameWriter writer{frame, region, sizes.width, sizes.height, 1, 16};
+    // Binning mixes the colors of each cell, leaving a monochrome image
+    if(! writer.region().binned())
+        frame.set_bayer_pattern(pattern_at(writer.region().y, writer.region().x));
+    const size_t raw_row_pixels = sizes.raw_pitch / sizeof(uint16_t);
+    writer.write_rows(raw_image + sizes.top_margin * raw_row_pixels + sizes.left_margin, raw_row_pixels, 1);
+    return true;
+}
+
+bool RawDecoder::decode_thumbnail(LibRaw& raw, Frame& frame, const Frame::Region &region)
+{
+    if(raw.unpack_thumb() != LIBRAW_SUCCESS)
+        return false;
+    const auto &thumbnail = raw.imgdata.thumbnail;
+    const uint8_t *thumbnail_data = reinterpret_cast<const uint8_t*>(thumbnail.thumb);
+    if(thumbnail.tformat == LIBRAW_THUMBNAIL_JPEG) {
+        JPEGDecoder{FullImage}.decode(thumbnail_data, thumbnail.tlength, frame, region);
+        return true;
+    }
+    if(thumbnail.tformat != LIBRAW_THUMBNAIL_BITMAP || (thumbnail.tcolors != 1 && thumbnail.tcolors != 3))
+        return false;
+    FrameWriter writer{frame, region, thumbnail.twidth, thumbnail.theight, thumbnail.tcolors, 8};
+    writer.write_rows(thumbnail_data, static_cast<size_t>(thumbnail.twidth) * thumbnail.tcolors);
+    return true;
+}
+
+vector<uint8_t> RawDecoder::jpeg_preview(const uint8_t* data, size_t size)
+{
+    unique_ptr<LibRaw> raw{new LibRaw};
+    check_libraw(raw->open_buffer(const_cast<uint8_t*>(data), size), "open");
+    // Most RAW formats embed a camera generated JPEG: extracting it is much cheaper than unpacking the sensor data
+    if(raw->unpack_thumb() != LIBRAW_SUCCESS || raw->imgdata.thumbnail.tformat != LIBRAW_THUMBNAIL_JPEG)
+        return {};
+    const uint8_t *thumbnail = reinterpret_cast<const uint8_t*>(raw->imgdata.thumbnail.thumb);
+    return {thumbnail, thumbnail + raw->imgdata.thumbnail.tlength};
+}
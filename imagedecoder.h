@@ -0,0 +1,82 @@
+/*
+ * Driver type: GPhoto Camera INDI Driver
+ *
+ * Copyright (C) 2016 Marco Gulino (marco AT gulinux.net)
+ *
+ * This library is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+#ifndef INDI_GPHOTO_IMAGEDECODER_H
+#define INDI_GPHOTO_IMAGEDECODER_H
+
+#include <memory>
+#include <string>
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include "frame.h"
+
+class LibRaw;
+namespace INDI {
+namespace GPhoto {
+/**
+ * Decodes a camera file straight into a Frame buffer: each decoded pixel is written exactly once, in its final planar position.
+ * Cropping and binning are applied while copying the decoded pixels, through a FrameWriter.
+ * Decoders throw std::runtime_error on invalid data.
+ */
+class ImageDecoder
+{
+public:
+    typedef std::shared_ptr<ImageDecoder> ptr;
+    /**
+     * FullImage decodes every pixel, HalfSize halves the resolution while decoding, Preview uses the cheapest low resolution image available.
+     * Bayer skips demosaicing, returning the raw sensor data (color filter array) as a single 16 bit plane.
+     * Native skips decoding altogether: cameras send their files as they are (see Frame::publish_file).
+     */
+    enum Mode { FullImage, HalfSize, Preview, Bayer, Native };
+    ImageDecoder(Mode mode) : mode{mode} {}
+    virtual ~ImageDecoder() {}
+    /// Decodes only the given region of the image, binning it as requested
+    virtual void decode(const uint8_t *data, std::size_t size, Frame &frame, const Frame::Region &region = {}) = 0;
+    /// JPEG image suitable as a preview, without decoding the full image. Empty if the file has none.
+    virtual std::vector<uint8_t> jpeg_preview(const uint8_t *data, std::size_t size) = 0;
+    static ptr for_file(const std::string &filename, Mode mode = FullImage);
+    /// Lower case extension of a camera file name (i.e. "cr2")
+    static std::string extension(const std::string &filename);
+protected:
+    const Mode mode;
+};
+
+class JPEGDecoder : public ImageDecoder
+{
+public:
+    JPEGDecoder(Mode mode = FullImage) : ImageDecoder{mode} {}
+    virtual void decode(const uint8_t *data, std::size_t size, Frame &frame, const Frame::Region &region = {});
+    virtual std::vector<uint8_t> jpeg_preview(const uint8_t *data, std::size_t size);
+};
+
+class RawDecoder : public ImageDecoder
+{
+public:
+    RawDecoder(Mode mode = FullImage) : ImageDecoder{mode} {}
+    virtual void decode(const uint8_t *data, std::size_t size, Frame &frame, const Frame::Region &region = {});
+    virtual std::vector<uint8_t> jpeg_preview(const uint8_t *data, std::size_t size);
+private:
+    bool decode_thumbnail(LibRaw &raw, Frame &frame, const Frame::Region &region);
+    bool decode_bayer(LibRaw &raw, Frame &frame, const Frame::Region &region);
+};
+}
+}
+
+#endif // INDI_GPHOTO_IMAGEDECODER_H
@@ -0,0 +1,138 @@
+/*
+ * Driver type: GPhoto Camera INDI Driver
+ *
+ * Copyright (C) 2016 Marco Gulino (marco AT gulinux.net)
+ *
+ * This library is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+#include "livestack.h"
+#include "frame.h"
+#include "parallel.h"
+#include "pixelkernels.h"
+#include <stdexcept>
+#include <vector>
+
+using namespace std;
+using namespace INDI::GPhoto;
+
+namespace {
+Frame::Geometry geometry_of(CCDChip &chip)
+{
+    Frame::Geometry geometry{chip.getSubW() / chip.getBinX(), chip.getSubH() / chip.getBinY(), chip.getNAxis() == 3 ? 3 : 1, chip.getBPP()};
+    if((geometry.bpp != 8 && geometry.bpp != 16) || geometry.bytes() != static_cast<size_t>(chip.getFrameBufferSize()))
+        throw runtime_error("Live stack: unsupported frame buffer");
+    return geometry;
+}
+}
+
+class LiveStack::Private {
+public:
+    Private(LiveStack *q);
+    Settings settings;
+    Frame::Geometry geometry{0, 0, 0, 0};
+    int frames = 0;
+    vector<float> means;
+    vector<float> m2;
+    vector<float> counts; ///< samples accepted for each mean
+    /// Runs `work` on the sample ranges of each row, split across threads
+    void for_rows(const function<void(size_t begin, size_t count)> &work) const;
+private:
+    LiveStack *q;
+};
+
+LiveStack::Private::Private(LiveStack* q) : q{q}
+{
+}
+
+LiveStack::LiveStack() : dptr(this)
+{
+}
+
+LiveStack::~LiveStack()
+{
+}
+
+void LiveStack::Private::for_rows(const function<void(size_t begin, size_t count)>& work) const
+{
+    const size_t width = geometry.width;
+    Parallel::for_rows(geometry.height * geometry.channels, [&](int begin, int end) {
+        work(begin * width, (end - begin) * width);
+    });
+}
+
+const LiveStack::Settings & LiveStack::settings() const
+{
+    return d->settings;
+}
+
+void LiveStack::set_settings(const Settings& settings)
+{
+    if(settings.mode != d->settings.mode)
+        reset();
+    d->settings = settings;
+}
+
+void LiveStack::reset()
+{
+    d->frames = 0;
+    d->geometry = {0, 0, 0, 0};
+    // Releases the planes: a full resolution color stack takes hundreds of megabytes
+    vector<float>().swap(d->means);
+    vector<float>().swap(d->m2);
+    vector<float>().swap(d->counts);
+}
+
+int LiveStack::frames() const
+{
+    return d->frames;
+}
+
+void LiveStack::add(CCDChip& chip)
+{
+    Frame::Geometry geometry = geometry_of(chip);
+    if(! (geometry == d->geometry)) {
+        reset();
+        d->geometry = geometry;
+        d->means.resize(geometry.pixels() * geometry.channels);
+        d->counts.resize(geometry.pixels() * geometry.channels);
+        if(d->settings.mode == SigmaClip)
+            d->m2.resize(geometry.pixels() * geometry.channels);
+    }
+    const float kappa2 = d->settings.kappa * d->settings.kappa;
+    float *means = d->means.data(), *m2 = d->m2.empty() ? nullptr : d->m2.data(), *counts = d->counts.data();
+    const uint8_t *buffer = chip.getFrameBuffer();
+    d->for_rows([=](size_t begin, size_t count) {
+        if(geometry.bpp == 8)
+            PixelKernels::stack(buffer + begin, count, means + begin, m2 ? m2 + begin : nullptr, counts + begin, kappa2);
+        else
+            PixelKernels::stack(reinterpret_cast<const uint16_t*>(buffer) + begin, count, means + begin, m2 ? m2 + begin : nullptr, counts + begin, kappa2);
+    });
+    d->frames++;
+}
+
+void LiveStack::write(CCDChip& chip) const
+{
+    if(d->frames == 0 || ! (geometry_of(chip) == d->geometry))
+        throw runtime_error("Live stack: frame buffer does not match the stacked frames");
+    const float *means = d->means.data();
+    uint8_t *buffer = chip.getFrameBuffer();
+    const int bpp = d->geometry.bpp;
+    d->for_rows([=](size_t begin, size_t count) {
+        if(bpp == 8)
+            PixelKernels::narrow(means + begin, count, buffer + begin);
+        else
+            PixelKernels::narrow(means + begin, count, reinterpret_cast<uint16_t*>(buffer) + begin);
+    });
+}
@@ -0,0 +1,62 @@
+/*
+ * Driver type: GPhoto Camera INDI Driver
+ *
+ * Copyright (C) 2016 Marco Gulino (marco AT gulinux.net)
+ *
+ * This library is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+#ifndef INDI_GPHOTO_LIVESTACK_H
+#define INDI_GPHOTO_LIVESTACK_H
+
+#include <indiccd.h>
+#include "c++/dptr.h"
+
+namespace INDI {
+namespace GPhoto {
+/**
+ * Stack of consecutive frames, accumulated as 32 bit float planes straight from the chip frame buffer once each frame is written.
+ * Mean mode keeps the running mean of each sample; sigma clipping mode also keeps the running variance (Welford's algorithm)
+ * and ignores the samples further than kappa standard deviations from the mean (satellite and plane trails, cosmic rays),
+ * once the sample has at least two accepted values which are not all equal. Each sample counts its own accepted values.
+ * Frames are not registered: the mount is expected to track during the stack.
+ * Must be used from the INDI event loop only; errors are reported by throwing std::runtime_error.
+ */
+class LiveStack
+{
+public:
+    enum Mode { Off, Mean, SigmaClip };
+    struct Settings {
+        Mode mode = Off;
+        int publish_every = 10; ///< the stacked frame replaces every this many frames
+        double kappa = 3;
+    };
+    LiveStack();
+    ~LiveStack();
+    const Settings &settings() const;
+    /// Changing the mode restarts the stack
+    void set_settings(const Settings &settings);
+    void reset();
+    /// Adds the frame in the chip buffer; a frame of a different geometry than the stacked ones restarts the stack
+    void add(CCDChip &chip);
+    int frames() const;
+    /// Replaces the frame in the chip buffer with the stacked one, in the same format
+    void write(CCDChip &chip) const;
+private:
+    D_PTR;
+};
+}
+}
+
+#endif // INDI_GPHOTO_LIVESTACK_H
@@ -0,0 +1,102 @@
+/*
+ * Driver type: GPhoto Camera INDI Driver
+ *
+ * Copyright (C) 2016 Marco Gulino (marco AT gulinux.net)
+ *
+ * This library is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+#include "liveview.h"
+#include "framepool.h"
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+
+using namespace std;
+using namespace INDI::GPhoto;
+
+class LiveView::Private {
+public:
+    Private(const Grab &grab, LiveView *q);
+    const Grab grab;
+    FramePool::ptr frame_pool;
+    mutable mutex frame_mutex;
+    Frame::ptr latest_frame;
+    uint64_t frames = 0;
+    uint64_t dropped = 0;
+    chrono::steady_clock::time_point started;
+    string error;
+    atomic<bool> running;
+    thread grab_thread;
+    void run();
+private:
+    LiveView *q;
+};
+
+LiveView::Private::Private(const Grab& grab, LiveView* q) : grab{grab}, frame_pool{make_shared<FramePool>(3)}, started{chrono::steady_clock::now()}, running{true}, q{q}
+{
+}
+
+void LiveView::Private::run()
+{
+    while(running) {
+        auto frame = make_shared<Frame>(frame_pool);
+        try {
+            grab(*frame);
+        } catch(std::exception &e) {
+            lock_guard<mutex> lock(frame_mutex);
+            error = e.what();
+            running = false;
+            return;
+        }
+        lock_guard<mutex> lock(frame_mutex);
+        frames++;
+        if(latest_frame)
+            dropped++;
+        latest_frame = frame;
+    }
+}
+
+LiveView::LiveView(const Grab& grab) : dptr(grab, this)
+{
+    d->grab_thread = thread{bind(&Private::run, d.get())};
+}
+
+LiveView::~LiveView()
+{
+    d->running = false;
+    d->grab_thread.join();
+}
+
+Frame::ptr LiveView::take_frame()
+{
+    lock_guard<mutex> lock(d->frame_mutex);
+    auto frame = d->latest_frame;
+    d->latest_frame.reset();
+    return frame;
+}
+
+LiveView::Stats LiveView::stats() const
+{
+    lock_guard<mutex> lock(d->frame_mutex);
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - d->started;
+    return {d->frames, d->dropped, d->frames / elapsed.count()};
+}
+
+string LiveView::error() const
+{
+    lock_guard<mutex> lock(d->frame_mutex);
+    return d->error;
+}
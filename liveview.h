@@ -0,0 +1,57 @@
+/*
+ * Driver type: GPhoto Camera INDI Driver
+ *
+ * Copyright (C) 2016 Marco Gulino (marco AT gulinux.net)
+ *
+ * This library is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+#ifndef INDI_GPHOTO_LIVEVIEW_H
+#define INDI_GPHOTO_LIVEVIEW_H
+
+#include <functional>
+#include <string>
+#include <cstdint>
+#include "frame.h"
+#include "c++/dptr.h"
+
+namespace INDI {
+namespace GPhoto {
+/**
+ * Continuously grabs live view frames on its own thread, as fast as the grab function returns them.
+ * Only the latest frame is kept: frames not taken before the next one is grabbed are dropped, so a slow client never delays the camera.
+ * Frame buffers are recycled through a FramePool.
+ */
+class LiveView
+{
+public:
+    typedef std::function<void(Frame &frame)> Grab;
+    struct Stats {
+        uint64_t frames;
+        uint64_t dropped;
+        double frames_per_second;
+    };
+    LiveView(const Grab &grab);
+    ~LiveView();
+    Frame::ptr take_frame();
+    Stats stats() const;
+    /// Grabbing stops on the first error, which is reported here
+    std::string error() const;
+private:
+    D_PTR;
+};
+}
+}
+
+#endif // INDI_GPHOTO_LIVEVIEW_H
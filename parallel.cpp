@@ -0,0 +1,168 @@
+/*
+ * Driver type: GPhoto Camera INDI Driver
+ *
+ * Copyright (C) 2016 Marco Gulino (marco AT gulinux.net)
+ *
+ * This library is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+#include "parallel.h"
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+using namespace std;
+using namespace INDI::GPhoto;
+
+namespace {
+thread_local int configured_threads = 0;
+// Below this, handing rows over to another thread costs more than copying them
+const int MIN_ROWS_PER_THREAD = 32;
+
+/**
+ * Helper threads shared by all the loops, started when a loop needs more of them and kept until the driver exits.
+ * Threads waiting for their loop run the queued tasks too, so loops complete even when helpers can't be started.
+ */
+class Pool {
+public:
+    typedef function<void()> Task;
+    static Pool &instance() {
+        static Pool pool;
+        return pool;
+    }
+    ~Pool() {
+        {
+            lock_guard<mutex> lock(tasks_mutex);
+            stopped = true;
+        }
+        tasks_changed.notify_all();
+        for(auto &helper: helpers)
+            helper.join();
+    }
+    void queue(const Task &task, size_t helpers_needed) {
+        {
+            lock_guard<mutex> lock(tasks_mutex);
+            tasks.push_back(task);
+            try {
+                while(helpers.size() < helpers_needed)
+                    helpers.emplace_back(&Pool::run, this);
+            } catch(std::system_error &) {
+            }
+        }
+        tasks_changed.notify_one();
+    }
+    /// Runs one queued task on the calling thread, returning false if none was waiting
+    bool run_one() {
+        Task task;
+        {
+            lock_guard<mutex> lock(tasks_mutex);
+            if(tasks.empty())
+                return false;
+            task = move(tasks.front());
+            tasks.pop_front();
+        }
+        task();
+        return true;
+    }
+private:
+    mutex tasks_mutex;
+    condition_variable tasks_changed;
+    deque<Task> tasks;
+    vector<thread> helpers;
+    bool stopped = false;
+    void run() {
+        while(true) {
+            Task task;
+            {
+                unique_lock<mutex> lock(tasks_mutex);
+                tasks_changed.wait(lock, [this] { return stopped || ! tasks.empty(); });
+                if(stopped)
+                    return;
+                task = move(tasks.front());
+                tasks.pop_front();
+            }
+            task();
+        }
+    }
+};
+
+/// Chunks of a loop still running, and the first exception thrown by one of them
+struct Loop {
+    mutex lock;
+    condition_variable done;
+    int pending;
+    exception_ptr error;
+    void run(const function<void(int, int)> &work, int begin, int end) {
+        exception_ptr chunk_error;
+        try {
+            work(begin, end);
+        } catch(...) {
+            chunk_error = current_exception();
+        }
+        {
+            lock_guard<mutex> guard(lock);
+            if(chunk_error && ! error)
+                error = chunk_error;
+            pending--;
+        }
+        done.notify_all();
+    }
+};
+}
+
+void Parallel::set_threads(int threads)
+{
+    configured_threads = max(threads, 0);
+}
+
+int Parallel::threads()
+{
+    int threads = configured_threads;
+    return threads > 0 ? threads : max(1, static_cast<int>(thread::hardware_concurrency()));
+}
+
+void Parallel::for_rows(int rows, const function<void(int, int)> &work)
+{
+    const int threads = max(1, min(Parallel::threads(), rows / MIN_ROWS_PER_THREAD));
+    const int chunk = (rows + threads - 1) / threads;
+    if(threads == 1) {
+        work(0, rows);
+        return;
+    }
+    auto loop = make_shared<Loop>();
+    loop->pending = (rows + chunk - 1) / chunk;
+    Pool &pool = Pool::instance();
+    for(int begin = chunk; begin < rows; begin += chunk) {
+        const int end = min(rows, begin + chunk);
+        try {
+            pool.queue([loop, &work, begin, end] { loop->run(work, begin, end); }, threads - 1);
+        } catch(std::bad_alloc &) {
+            loop->run(work, begin, end);
+        }
+    }
+    loop->run(work, 0, min(rows, chunk));
+    // Every chunk must be done before returning, even when one failed: they all use `work`
+    while(pool.run_one())
+        ;
+    unique_lock<mutex> lock(loop->lock);
+    loop->done.wait(lock, [&] { return loop->pending == 0; });
+    if(loop->error)
+        rethrow_exception(loop->error);
+}
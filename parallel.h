@@ -0,0 +1,46 @@
+/*
+ * Driver type: GPhoto Camera INDI Driver
+ *
+ * Copyright (C) 2016 Marco Gulino (marco AT gulinux.net)
+ *
+ * This library is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+#ifndef INDI_GPHOTO_PARALLEL_H
+#define INDI_GPHOTO_PARALLEL_H
+
+#include <functional>
+
+namespace INDI {
+namespace GPhoto {
+/**
+ * Splits loops over image rows across a pool of threads shared by all the cameras, for the decoding and copy stages.
+ * The number of threads is set for the loops run by the calling thread (i.e. each camera worker), 0 (the default)
+ * meaning one for each core; it is also given to LibRaw when it is built with OpenMP.
+ */
+namespace Parallel {
+/// Sets the number of threads for the loops run by the calling thread
+void set_threads(int threads);
+/// Number of threads the loops of the calling thread are split across: the configured one, or the number of cores
+int threads();
+/**
+ * Runs `work` on consecutive ranges of rows covering [0, rows), one for each thread; returns when all are done.
+ * If `work` throws, the first exception is thrown again once all the ranges are done.
+ */
+void for_rows(int rows, const std::function<void(int begin, int end)> &work);
+}
+}
+}
+
+#endif // INDI_GPHOTO_PARALLEL_H
@@ -0,0 +1,641 @@
+/*
+ * Driver type: GPhoto Camera INDI Driver
+ *
+ * Copyright (C) 2016 Marco Gulino (marco AT gulinux.net)
+ *
+ * This library is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+#include "pixelkernels.h"
+#include <atomic>
+#include <algorithm>
+#include <cstring>
+#include <cmath>
+#include <limits>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define INDI_GPHOTO_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+using namespace std;
+using namespace INDI::GPhoto;
+
+namespace {
+struct Kernels {
+    void (*deinterleave8)(const uint8_t *source, size_t pixels, int channels, uint8_t * const *planes);
+    void (*deinterleave16)(const uint16_t *source, size_t pixels, int stride, int channels, uint16_t * const *planes);
+    void (*widen)(const uint8_t *source, size_t count, uint16_t *destination);
+    void (*swap_bytes)(uint16_t *data, size_t count);
+    void (*accumulate8)(const uint8_t *source, size_t count, uint32_t *sums);
+    void (*accumulate16)(const uint16_t *source, size_t count, uint32_t *sums);
+    void (*calibrate8)(uint8_t *samples, size_t count, const float *offset, const float *gain);
+    void (*calibrate16)(uint16_t *samples, size_t count, const float *offset, const float *gain);
+    void (*stack8)(const uint8_t *source, size_t count, float *means, float *m2, float *counts, float kappa2);
+    void (*stack16)(const uint16_t *source, size_t count, float *means, float *m2, float *counts, float kappa2);
+    void (*narrow8)(const float *source, size_t count, uint8_t *destination);
+    void (*narrow16)(const float *source, size_t count, uint16_t *destination);
+};
+
+namespace scalar {
+void deinterleave8(const uint8_t *source, size_t pixels, int channels, uint8_t * const *planes)
+{
+    if(channels == 1) {
+        memcpy(planes[0], source, pixels);
+        return;
+    }
+    for(int channel = 0; channel < channels; channel++) {
+        uint8_t *destination = planes[channel];
+        const uint8_t *channel_source = source + channel;
+        for(size_t pixel = 0; pixel < pixels; pixel++)
+            destination[pixel] = channel_source[pixel * channels];
+    }
+}
+
+void deinterleave16(const uint16_t *source, size_t pixels, int stride, int channels, uint16_t * const *planes)
+{
+    if(channels == 1 && stride == 1) {
+        memcpy(planes[0], source, pixels * sizeof(uint16_t));
+        return;
+    }
+    for(int channel = 0; channel < channels; channel++) {
+        uint16_t *destination = planes[channel];
+        const uint16_t *channel_source = source + channel;
+        for(size_t pixel = 0; pixel < pixels; pixel++)
+            destination[pixel] = channel_source[pixel * stride];
+    }
+}
+
+void widen(const uint8_t *source, size_t count, uint16_t *destination)
+{
+    for(size_t index = 0; index < count; index++)
+        destination[index] = source[index] * 257;
+}
+
+void swap_bytes(uint16_t *data, size_t count)
+{
+    for(size_t index = 0; index < count; index++)
+        data[index] = static_cast<uint16_t>(data[index] << 8 | data[index] >> 8);
+}
+
+template<typename T> void accumulate(const T *source, size_t count, uint32_t *sums)
+{
+    for(size_t index = 0; index < count; index++)
+        sums[index] += source[index];
+}
+
+// Same operations, in the same order, as the SIMD versions, so that all of them give the same output
+template<typename T> void calibrate(T *samples, size_t count, const float *offset, const float *gain)
+{
+    const float max_value = numeric_limits<T>::max();
+    for(size_t index = 0; index < count; index++) {
+        float value = (static_cast<float>(samples[index]) - offset[index]) * gain[index];
+        samples[index] = static_cast<T>(lrintf(min(max(value, 0.f), max_value)));
+    }
+}
+
+template<typename T> void stack(const T *source, size_t count, float *means, float *m2, float *counts, float kappa2)
+{
+    for(size_t index = 0; index < count; index++) {
+        const float sample = source[index];
+        const float delta = sample - means[index];
+        // Variance is m2 / (count - 1): rejects when delta^2 > kappa^2 * variance
+        if(m2 && kappa2 > 0 && counts[index] >= 2 && m2[index] > 0 && delta * delta * (counts[index] - 1) > kappa2 * m2[index])
+            continue;
+        counts[index] = counts[index] + 1;
+        means[index] = means[index] + delta / counts[index];
+        if(m2)
+            m2[index] = m2[index] + delta * (sample - means[index]);
+    }
+}
+
+template<typename T> void narrow(const float *source, size_t count, T *destination)
+{
+    const float max_value = numeric_limits<T>::max();
+    for(size_t index = 0; index < count; index++)
+        destination[index] = static_cast<T>(lrintf(min(max(source[index], 0.f), max_value)));
+}
+
+const Kernels kernels{deinterleave8, deinterleave16, widen, swap_bytes, accumulate<uint8_t>, accumulate<uint16_t>, calibrate<uint8_t>, calibrate<uint16_t>,
+    stack<uint8_t>, stack<uint16_t>, narrow<uint8_t>, narrow<uint16_t>};
+}
+
+#ifdef INDI_GPHOTO_X86_KERNELS
+// Each SIMD kernel processes whole blocks, leaving the remaining pixels to the scalar version.
+namespace sse2 {
+__attribute__((target("sse2"))) void deinterleave16(const uint16_t *source, size_t pixels, int stride, int channels, uint16_t * const *planes)
+{
+    if(stride != 4 || channels != 3) {
+        scalar::deinterleave16(source, pixels, stride, channels, planes);
+        return;
+    }
+    // 8 RGBx pixels per iteration, transposed with 16 and 64 bit unpacks
+    const size_t blocks = pixels / 8;
+    for(size_t block = 0; block < blocks; block++) {
+        const __m128i *input = reinterpret_cast<const __m128i*>(source + block * 32);
+        __m128i p0 = _mm_loadu_si128(input), p1 = _mm_loadu_si128(input + 1), p2 = _mm_loadu_si128(input + 2), p3 = _mm_loadu_si128(input + 3);
+        __m128i t0 = _mm_unpacklo_epi16(p0, p1), t1 = _mm_unpackhi_epi16(p0, p1);
+        __m128i t2 = _mm_unpacklo_epi16(p2, p3), t3 = _mm_unpackhi_epi16(p2, p3);
+        __m128i u0 = _mm_unpacklo_epi16(t0, t1), u1 = _mm_unpackhi_epi16(t0, t1);
+        __m128i u2 = _mm_unpacklo_epi16(t2, t3), u3 = _mm_unpackhi_epi16(t2, t3);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(planes[0] + block * 8), _mm_unpacklo_epi64(u0, u2));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(planes[1] + block * 8), _mm_unpackhi_epi64(u0, u2));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(planes[2] + block * 8), _mm_unpacklo_epi64(u1, u3));
+    }
+    const size_t done = blocks * 8;
+    uint16_t *tail_planes[] = {planes[0] + done, planes[1] + done, planes[2] + done};
+    scalar::deinterleave16(source + done * 4, pixels - done, stride, channels, tail_planes);
+}
+
+__attribute__((target("sse2"))) void widen(const uint8_t *source, size_t count, uint16_t *destination)
+{
+    // Unpacking a byte with itself gives v << 8 | v, that is v * 257
+    const size_t blocks = count / 16;
+    for(size_t block = 0; block < blocks; block++) {
+        __m128i value = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + block * 16));
+        __m128i *output = reinterpret_cast<__m128i*>(destination + block * 16);
+        _mm_storeu_si128(output, _mm_unpacklo_epi8(value, value));
+        _mm_storeu_si128(output + 1, _mm_unpackhi_epi8(value, value));
+    }
+    scalar::widen(source + blocks * 16, count - blocks * 16, destination + blocks * 16);
+}
+
+__attribute__((target("sse2"))) void swap_bytes(uint16_t *data, size_t count)
+{
+    const size_t blocks = count / 8;
+    for(size_t block = 0; block < blocks; block++) {
+        __m128i *pointer = reinterpret_cast<__m128i*>(data + block * 8);
+        __m128i value = _mm_loadu_si128(pointer);
+        _mm_storeu_si128(pointer, _mm_or_si128(_mm_slli_epi16(value, 8), _mm_srli_epi16(value, 8)));
+    }
+    scalar::swap_bytes(data + blocks * 8, count - blocks * 8);
+}
+
+__attribute__((target("sse2"))) inline void add_to_sums(__m128i values, uint32_t *sums)
+{
+    __m128i *pointer = reinterpret_cast<__m128i*>(sums);
+    _mm_storeu_si128(pointer, _mm_add_epi32(_mm_loadu_si128(pointer), values));
+}
+
+__attribute__((target("sse2"))) void accumulate8(const uint8_t *source, size_t count, uint32_t *sums)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const size_t blocks = count / 16;
+    for(size_t block = 0; block < blocks; block++) {
+        __m128i value = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + block * 16));
+        __m128i low = _mm_unpacklo_epi8(value, zero), high = _mm_unpackhi_epi8(value, zero);
+        uint32_t *block_sums = sums + block * 16;
+        add_to_sums(_mm_unpacklo_epi16(low, zero), block_sums);
+        add_to_sums(_mm_unpackhi_epi16(low, zero), block_sums + 4);
+        add_to_sums(_mm_unpacklo_epi16(high, zero), block_sums + 8);
+        add_to_sums(_mm_unpackhi_epi16(high, zero), block_sums + 12);
+    }
+    scalar::accumulate(source + blocks * 16, count - blocks * 16, sums + blocks * 16);
+}
+
+__attribute__((target("sse2"))) void accumulate16(const uint16_t *source, size_t count, uint32_t *sums)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const size_t blocks = count / 8;
+    for(size_t block = 0; block < blocks; block++) {
+        __m128i value = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + block * 8));
+        add_to_sums(_mm_unpacklo_epi16(value, zero), sums + block * 8);
+        add_to_sums(_mm_unpackhi_epi16(value, zero), sums + block * 8 + 4);
+    }
+    scalar::accumulate(source + blocks * 8, count - blocks * 8, sums + blocks * 8);
+}
+
+__attribute__((target("sse2"))) __m128i calibrate4(__m128i samples, const float *offset, const float *gain)
+{
+    __m128 value = _mm_mul_ps(_mm_sub_ps(_mm_cvtepi32_ps(samples), _mm_loadu_ps(offset)), _mm_loadu_ps(gain));
+    return _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(value, _mm_setzero_ps()), _mm_set1_ps(65535)));
+}
+
+__attribute__((target("sse2"))) void calibrate16(uint16_t *samples, size_t count, const float *offset, const float *gain)
+{
+    // SSE2 can only pack 32 bit integers with signed saturation: shift them to the signed range and back
+    const __m128i zero = _mm_setzero_si128(), bias32 = _mm_set1_epi32(0x8000), bias16 = _mm_set1_epi16(-0x8000);
+    const size_t blocks = count / 8;
+    for(size_t block = 0; block < blocks; block++) {
+        __m128i *pointer = reinterpret_cast<__m128i*>(samples + block * 8);
+        __m128i value = _mm_loadu_si128(pointer);
+        __m128i low = calibrate4(_mm_unpacklo_epi16(value, zero), offset + block * 8, gain + block * 8);
+        __m128i high = calibrate4(_mm_unpackhi_epi16(value, zero), offset + block * 8 + 4, gain + block * 8 + 4);
+        __m128i packed = _mm_packs_epi32(_mm_sub_epi32(low, bias32), _mm_sub_epi32(high, bias32));
+        _mm_storeu_si128(pointer, _mm_xor_si128(packed, bias16));
+    }
+    const size_t done = blocks * 8;
+    scalar::calibrate(samples + done, count - done, offset + done, gain + done);
+}
+
+__attribute__((target("sse2"))) void stack4(__m128 sample, float *means, float *m2, float *counts, __m128 kappa2)
+{
+    const __m128 one = _mm_set1_ps(1);
+    __m128 mean = _mm_loadu_ps(means), count = _mm_loadu_ps(counts);
+    __m128 delta = _mm_sub_ps(sample, mean);
+    __m128 accepted = _mm_castsi128_ps(_mm_set1_epi32(-1));
+    if(m2) {
+        __m128 variance = _mm_loadu_ps(m2);
+        __m128 rejected = _mm_cmpgt_ps(_mm_mul_ps(_mm_mul_ps(delta, delta), _mm_sub_ps(count, one)), _mm_mul_ps(kappa2, variance));
+        rejected = _mm_and_ps(rejected, _mm_and_ps(_mm_cmpge_ps(count, _mm_set1_ps(2)), _mm_cmpgt_ps(variance, _mm_setzero_ps())));
+        accepted = _mm_andnot_ps(_mm_and_ps(rejected, _mm_cmpgt_ps(kappa2, _mm_setzero_ps())), accepted);
+    }
+    // Rejected samples keep count, mean and m2 unchanged: the increments are masked out
+    __m128 new_count = _mm_add_ps(count, _mm_and_ps(accepted, one));
+    __m128 new_mean = _mm_add_ps(mean, _mm_and_ps(accepted, _mm_div_ps(delta, new_count)));
+    _mm_storeu_ps(counts, new_count);
+    _mm_storeu_ps(means, new_mean);
+    if(m2)
+        _mm_storeu_ps(m2, _mm_add_ps(_mm_loadu_ps(m2), _mm_and_ps(accepted, _mm_mul_ps(delta, _mm_sub_ps(sample, new_mean)))));
+}
+
+__attribute__((target("sse2"))) void stack16(const uint16_t *source, size_t count, float *means, float *m2, float *counts, float kappa2)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128 kappa2s = _mm_set1_ps(kappa2);
+    const size_t blocks = count / 4;
+    for(size_t block = 0; block < blocks; block++) {
+        __m128i value = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(source + block * 4));
+        stack4(_mm_cvtepi32_ps(_mm_unpacklo_epi16(value, zero)), means + block * 4, m2 ? m2 + block * 4 : nullptr, counts + block * 4, kappa2s);
+    }
+    const size_t done = blocks * 4;
+    scalar::stack(source + done, count - done, means + done, m2 ? m2 + done : nullptr, counts + done, kappa2);
+}
+
+__attribute__((target("sse2"))) void narrow16(const float *source, size_t count, uint16_t *destination)
+{
+    const __m128i bias32 = _mm_set1_epi32(0x8000), bias16 = _mm_set1_epi16(-0x8000);
+    const __m128 max_value = _mm_set1_ps(65535);
+    const size_t blocks = count / 8;
+    for(size_t block = 0; block < blocks; block++) {
+        __m128i low = _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(source + block * 8), _mm_setzero_ps()), max_value));
+        __m128i high = _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(source + block * 8 + 4), _mm_setzero_ps()), max_value));
+        __m128i packed = _mm_packs_epi32(_mm_sub_epi32(low, bias32), _mm_sub_epi32(high, bias32));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(destination + block * 8), _mm_xor_si128(packed, bias16));
+    }
+    const size_t done = blocks * 8;
+    scalar::narrow(source + done, count - done, destination + done);
+}
+
+// SSE2 has no byte shuffle, so 3 channels 8 bit pixels are left to the scalar loop; so are the other 8 bit kernels but accumulate
+const Kernels kernels{scalar::deinterleave8, deinterleave16, widen, swap_bytes, accumulate8, accumulate16, scalar::calibrate<uint8_t>, calibrate16,
+    scalar::stack<uint8_t>, stack16, scalar::narrow<uint8_t>, narrow16};
+}
+
+namespace avx2 {
+struct RGBShuffleMasks {
+    // masks[channel][register]: selects the bytes of `channel` found in each of the three 16 bytes registers of 16 RGB pixels
+    __m128i masks[3][3];
+    __attribute__((target("avx2"))) RGBShuffleMasks() {
+        for(int channel = 0; channel < 3; channel++) {
+            for(int reg = 0; reg < 3; reg++) {
+                alignas(16) int8_t mask[16];
+                for(int pixel = 0; pixel < 16; pixel++) {
+                    int position = pixel * 3 + channel - reg * 16;
+                    mask[pixel] = position >= 0 && position < 16 ? position : -128;
+                }
+                masks[channel][reg] = _mm_load_si128(reinterpret_cast<const __m128i*>(mask));
+            }
+        }
+    }
+};
+
+__attribute__((target("avx2"))) void deinterleave8(const uint8_t *source, size_t pixels, int channels, uint8_t * const *planes)
+{
+    if(channels != 3) {
+        scalar::deinterleave8(source, pixels, channels, planes);
+        return;
+    }
+    static const RGBShuffleMasks rgb_masks;
+    __m256i masks[3][3];
+    for(int channel = 0; channel < 3; channel++)
+        for(int reg = 0; reg < 3; reg++)
+            masks[channel][reg] = _mm256_broadcastsi128_si256(rgb_masks.masks[channel][reg]);
+    // 32 pixels per iteration: the low lanes hold pixels 0-15, the high lanes pixels 16-31, so byte shuffles never cross lanes
+    const size_t blocks = pixels / 32;
+    for(size_t block = 0; block < blocks; block++) {
+        const __m128i *input = reinterpret_cast<const __m128i*>(source + block * 96);
+        __m256i in[3];
+        for(int reg = 0; reg < 3; reg++)
+            in[reg] = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128(input + reg)), _mm_loadu_si128(input + reg + 3), 1);
+        for(int channel = 0; channel < 3; channel++) {
+            __m256i value = _mm256_or_si256(
+                _mm256_or_si256(_mm256_shuffle_epi8(in[0], masks[channel][0]), _mm256_shuffle_epi8(in[1], masks[channel][1])),
+                _mm256_shuffle_epi8(in[2], masks[channel][2]));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(planes[channel] + block * 32), value);
+        }
+    }
+    const size_t done = blocks * 32;
+    uint8_t *tail_planes[] = {planes[0] + done, planes[1] + done, planes[2] + done};
+    scalar::deinterleave8(source + done * 3, pixels - done, channels, tail_planes);
+}
+
+__attribute__((target("avx2"))) void deinterleave16(const uint16_t *source, size_t pixels, int stride, int channels, uint16_t * const *planes)
+{
+    if(stride != 4 || channels != 3) {
+        scalar::deinterleave16(source, pixels, stride, channels, planes);
+        return;
+    }
+    // Same transposition as SSE2, on 16 pixels: low lanes hold pixels 0-7, high lanes pixels 8-15
+    const size_t blocks = pixels / 16;
+    for(size_t block = 0; block < blocks; block++) {
+        const __m128i *input = reinterpret_cast<const __m128i*>(source + block * 64);
+        __m256i p[4];
+        for(int reg = 0; reg < 4; reg++)
+            p[reg] = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128(input + reg)), _mm_loadu_si128(input + reg + 4), 1);
+        __m256i t0 = _mm256_unpacklo_epi16(p[0], p[1]), t1 = _mm256_unpackhi_epi16(p[0], p[1]);
+        __m256i t2 = _mm256_unpacklo_epi16(p[2], p[3]), t3 = _mm256_unpackhi_epi16(p[2], p[3]);
+        __m256i u0 = _mm256_unpacklo_epi16(t0, t1), u1 = _mm256_unpackhi_epi16(t0, t1);
+        __m256i u2 = _mm256_unpacklo_epi16(t2, t3), u3 = _mm256_unpackhi_epi16(t2, t3);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(planes[0] + block * 16), _mm256_unpacklo_epi64(u0, u2));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(planes[1] + block * 16), _mm256_unpackhi_epi64(u0, u2));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(planes[2] + block * 16), _mm256_unpacklo_epi64(u1, u3));
+    }
+    const size_t done = blocks * 16;
+    uint16_t *tail_planes[] = {planes[0] + done, planes[1] + done, planes[2] + done};
+    scalar::deinterleave16(source + done * 4, pixels - done, stride, channels, tail_planes);
+}
+
+__attribute__((target("avx2"))) void widen(const uint8_t *source, size_t count, uint16_t *destination)
+{
+    const size_t blocks = count / 16;
+    for(size_t block = 0; block < blocks; block++) {
+        __m256i value = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(source + block * 16)));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(destination + block * 16), _mm256_or_si256(value, _mm256_slli_epi16(value, 8)));
+    }
+    scalar::widen(source + blocks * 16, count - blocks * 16, destination + blocks * 16);
+}
+
+__attribute__((target("avx2"))) void swap_bytes(uint16_t *data, size_t count)
+{
+    const size_t blocks = count / 16;
+    for(size_t block = 0; block < blocks; block++) {
+        __m256i *pointer = reinterpret_cast<__m256i*>(data + block * 16);
+        __m256i value = _mm256_loadu_si256(pointer);
+        _mm256_storeu_si256(pointer, _mm256_or_si256(_mm256_slli_epi16(value, 8), _mm256_srli_epi16(value, 8)));
+    }
+    scalar::swap_bytes(data + blocks * 16, count - blocks * 16);
+}
+
+__attribute__((target("avx2"))) void accumulate8(const uint8_t *source, size_t count, uint32_t *sums)
+{
+    const size_t blocks = count / 8;
+    for(size_t block = 0; block < blocks; block++) {
+        __m256i *pointer = reinterpret_cast<__m256i*>(sums + block * 8);
+        __m256i value = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(source + block * 8)));
+        _mm256_storeu_si256(pointer, _mm256_add_epi32(_mm256_loadu_si256(pointer), value));
+    }
+    scalar::accumulate(source + blocks * 8, count - blocks * 8, sums + blocks * 8);
+}
+
+__attribute__((target("avx2"))) void accumulate16(const uint16_t *source, size_t count, uint32_t *sums)
+{
+    const size_t blocks = count / 8;
+    for(size_t block = 0; block < blocks; block++) {
+        __m256i *pointer = reinterpret_cast<__m256i*>(sums + block * 8);
+        __m256i value = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(source + block * 8)));
+        _mm256_storeu_si256(pointer, _mm256_add_epi32(_mm256_loadu_si256(pointer), value));
+    }
+    scalar::accumulate(source + blocks * 8, count - blocks * 8, sums + blocks * 8);
+}
+
+__attribute__((target("avx2"))) __m256i calibrate8(__m256i samples, const float *offset, const float *gain, float max_value)
+{
+    __m256 value = _mm256_mul_ps(_mm256_sub_ps(_mm256_cvtepi32_ps(samples), _mm256_loadu_ps(offset)), _mm256_loadu_ps(gain));
+    return _mm256_cvtps_epi32(_mm256_min_ps(_mm256_max_ps(value, _mm256_setzero_ps()), _mm256_set1_ps(max_value)));
+}
+
+__attribute__((target("avx2"))) void calibrate8(uint8_t *samples, size_t count, const float *offset, const float *gain)
+{
+    const size_t blocks = count / 8;
+    for(size_t block = 0; block < blocks; block++) {
+        __m128i *pointer = reinterpret_cast<__m128i*>(samples + block * 8);
+        __m256i value = calibrate8(_mm256_cvtepu8_epi32(_mm_loadl_epi64(pointer)), offset + block * 8, gain + block * 8, 255);
+        // Values are already clamped: packing just narrows them
+        __m128i words = _mm_packus_epi32(_mm256_castsi256_si128(value), _mm256_extracti128_si256(value, 1));
+        _mm_storel_epi64(pointer, _mm_packus_epi16(words, words));
+    }
+    const size_t done = blocks * 8;
+    scalar::calibrate(samples + done, count - done, offset + done, gain + done);
+}
+
+__attribute__((target("avx2"))) void calibrate16(uint16_t *samples, size_t count, const float *offset, const float *gain)
+{
+    const size_t blocks = count / 16;
+    for(size_t block = 0; block < blocks; block++) {
+        __m256i *pointer = reinterpret_cast<__m256i*>(samples + block * 16);
+        __m256i value = _mm256_loadu_si256(pointer);
+        __m256i low = calibrate8(_mm256_cvtepu16_epi32(_mm256_castsi256_si128(value)), offset + block * 16, gain + block * 16, 65535);
+        __m256i high = calibrate8(_mm256_cvtepu16_epi32(_mm256_extracti128_si256(value, 1)), offset + block * 16 + 8, gain + block * 16 + 8, 65535);
+        // Packing works within 128 bit lanes: put the 64 bit quarters back in order
+        _mm256_storeu_si256(pointer, _mm256_permute4x64_epi64(_mm256_packus_epi32(low, high), 0xD8));
+    }
+    const size_t done = blocks * 16;
+    scalar::calibrate(samples + done, count - done, offset + done, gain + done);
+}
+
+__attribute__((target("avx2"))) __m256i load8(const uint8_t *source)
+{
+    return _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(source)));
+}
+
+__attribute__((target("avx2"))) __m256i load8(const uint16_t *source)
+{
+    return _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(source)));
+}
+
+template<typename T> __attribute__((target("avx2"))) void stack(const T *source, size_t count, float *means, float *m2, float *counts, float kappa2)
+{
+    const __m256 one = _mm256_set1_ps(1), two = _mm256_set1_ps(2), kappa2s = _mm256_set1_ps(kappa2);
+    const bool clipping = m2 && kappa2 > 0;
+    const size_t blocks = count / 8;
+    for(size_t block = 0; block < blocks; block++) {
+        const size_t offset = block * 8;
+        __m256 sample = _mm256_cvtepi32_ps(load8(source + offset));
+        __m256 mean = _mm256_loadu_ps(means + offset), samples = _mm256_loadu_ps(counts + offset);
+        __m256 delta = _mm256_sub_ps(sample, mean);
+        __m256 accepted = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        if(clipping) {
+            __m256 variance = _mm256_loadu_ps(m2 + offset);
+            __m256 rejected = _mm256_cmp_ps(_mm256_mul_ps(_mm256_mul_ps(delta, delta), _mm256_sub_ps(samples, one)), _mm256_mul_ps(kappa2s, variance), _CMP_GT_OQ);
+            rejected = _mm256_and_ps(rejected, _mm256_and_ps(_mm256_cmp_ps(samples, two, _CMP_GE_OQ), _mm256_cmp_ps(variance, _mm256_setzero_ps(), _CMP_GT_OQ)));
+            accepted = _mm256_andnot_ps(rejected, accepted);
+        }
+        __m256 new_count = _mm256_add_ps(samples, _mm256_and_ps(accepted, one));
+        __m256 new_mean = _mm256_add_ps(mean, _mm256_and_ps(accepted, _mm256_div_ps(delta, new_count)));
+        _mm256_storeu_ps(counts + offset, new_count);
+        _mm256_storeu_ps(means + offset, new_mean);
+        if(m2)
+            _mm256_storeu_ps(m2 + offset, _mm256_add_ps(_mm256_loadu_ps(m2 + offset), _mm256_and_ps(accepted, _mm256_mul_ps(delta, _mm256_sub_ps(sample, new_mean)))));
+    }
+    const size_t done = blocks * 8;
+    scalar::stack(source + done, count - done, means + done, m2 ? m2 + done : nullptr, counts + done, kappa2);
+}
+
+__attribute__((target("avx2"))) __m256i narrow8(const float *source, float max_value)
+{
+    return _mm256_cvtps_epi32(_mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(source), _mm256_setzero_ps()), _mm256_set1_ps(max_value)));
+}
+
+__attribute__((target("avx2"))) void narrow8(const float *source, size_t count, uint8_t *destination)
+{
+    const size_t blocks = count / 8;
+    for(size_t block = 0; block < blocks; block++) {
+        __m256i value = narrow8(source + block * 8, 255);
+        __m128i words = _mm_packus_epi32(_mm256_castsi256_si128(value), _mm256_extracti128_si256(value, 1));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(destination + block * 8), _mm_packus_epi16(words, words));
+    }
+    const size_t done = blocks * 8;
+    scalar::narrow(source + done, count - done, destination + done);
+}
+
+__attribute__((target("avx2"))) void narrow16(const float *source, size_t count, uint16_t *destination)
+{
+    const size_t blocks = count / 16;
+    for(size_t block = 0; block < blocks; block++) {
+        __m256i packed = _mm256_packus_epi32(narrow8(source + block * 16, 65535), narrow8(source + block * 16 + 8, 65535));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(destination + block * 16), _mm256_permute4x64_epi64(packed, 0xD8));
+    }
+    const size_t done = blocks * 16;
+    scalar::narrow(source + done, count - done, destination + done);
+}
+
+const Kernels kernels{deinterleave8, deinterleave16, widen, swap_bytes, accumulate8, accumulate16, calibrate8, calibrate16,
+    stack<uint8_t>, stack<uint16_t>, narrow8, narrow16};
+}
+#endif
+
+const Kernels &kernels_for(PixelKernels::InstructionSet instruction_set)
+{
+#ifdef INDI_GPHOTO_X86_KERNELS
+    if(instruction_set == PixelKernels::AVX2)
+        return avx2::kernels;
+    if(instruction_set == PixelKernels::SSE2)
+        return sse2::kernels;
+#endif
+    return scalar::kernels;
+}
+
+atomic<const Kernels*> &active_kernels()
+{
+    static atomic<const Kernels*> active{&kernels_for(PixelKernels::supported().back())};
+    return active;
+}
+
+atomic<PixelKernels::InstructionSet> &active_instruction_set()
+{
+    static atomic<PixelKernels::InstructionSet> active{PixelKernels::supported().back()};
+    return active;
+}
+}
+
+vector<PixelKernels::InstructionSet> PixelKernels::supported()
+{
+    vector<InstructionSet> instruction_sets{Scalar};
+#ifdef INDI_GPHOTO_X86_KERNELS
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("sse2"))
+        instruction_sets.push_back(SSE2);
+    if(__builtin_cpu_supports("avx2"))
+        instruction_sets.push_back(AVX2);
+#endif
+    return instruction_sets;
+}
+
+PixelKernels::InstructionSet PixelKernels::current()
+{
+    return active_instruction_set();
+}
+
+bool PixelKernels::use(InstructionSet instruction_set)
+{
+    auto instruction_sets = supported();
+    if(find(instruction_sets.begin(), instruction_sets.end(), instruction_set) == instruction_sets.end())
+        return false;
+    active_kernels() = &kernels_for(instruction_set);
+    active_instruction_set() = instruction_set;
+    return true;
+}
+
+const char *PixelKernels::name(InstructionSet instruction_set)
+{
+    switch(instruction_set) {
+        case SSE2:
+            return "SSE2";
+        case AVX2:
+            return "AVX2";
+        default:
+            return "Scalar";
+    }
+}
+
+void PixelKernels::deinterleave(const uint8_t* source, size_t pixels, int channels, uint8_t * const * planes)
+{
+    active_kernels().load()->deinterleave8(source, pixels, channels, planes);
+}
+
+void PixelKernels::deinterleave(const uint16_t* source, size_t pixels, int stride, int channels, uint16_t * const * planes)
+{
+    active_kernels().load()->deinterleave16(source, pixels, stride, channels, planes);
+}
+
+void PixelKernels::widen(const uint8_t* source, size_t count, uint16_t* destination)
+{
+    active_kernels().load()->widen(source, count, destination);
+}
+
+void PixelKernels::swap_bytes(uint16_t* data, size_t count)
+{
+    active_kernels().load()->swap_bytes(data, count);
+}
+
+void PixelKernels::accumulate(const uint8_t* source, size_t count, uint32_t* sums)
+{
+    active_kernels().load()->accumulate8(source, count, sums);
+}
+
+void PixelKernels::accumulate(const uint16_t* source, size_t count, uint32_t* sums)
+{
+    active_kernels().load()->accumulate16(source, count, sums);
+}
+
+void PixelKernels::calibrate(uint8_t* samples, size_t count, const float* offset, const float* gain)
+{
+    active_kernels().load()->calibrate8(samples, count, offset, gain);
+}
+
+void PixelKernels::calibrate(uint16_t* samples, size_t count, const float* offset, const float* gain)
+{
+    active_kernels().load()->calibrate16(samples, count, offset, gain);
+}
+
+void PixelKernels::stack(const uint8_t* source, size_t count, float* means, float* m2, float* counts, float kappa2)
+{
+    active_kernels().load()->stack8(source, count, means, m2, counts, kappa2);
+}
+
+void PixelKernels::stack(const uint16_t* source, size_t count, float* means, float* m2, float* counts, float kappa2)
+{
+    active_kernels().load()->stack16(source, count, means, m2, counts, kappa2);
+}
+
+void PixelKernels::narrow(const float* source, size_t count, uint8_t* destination)
+{
+    active_kernels().load()->narrow8(source, count, destination);
+}
+
+void PixelKernels::narrow(const float* source, size_t count, uint16_t* destination)
+{
+    active_kernels().load()->narrow16(source, count, destination);
+}
@@ -0,0 +1,71 @@
+/*
+ * Driver type: GPhoto Camera INDI Driver
+ *
+ * Copyright (C) 2016 Marco Gulino (marco AT gulinux.net)
+ *
+ * This library is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+#ifndef INDI_GPHOTO_PIXELKERNELS_H
+#define INDI_GPHOTO_PIXELKERNELS_H
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+namespace INDI {
+namespace GPhoto {
+/**
+ * Pixel conversion loops used when moving decoded images into frame planes.
+ * Each kernel has a scalar implementation and, on x86, SSE2 and AVX2 ones: the best instruction set
+ * supported by the running CPU is picked on first use, so the driver binary stays portable.
+ */
+namespace PixelKernels {
+enum InstructionSet { Scalar, SSE2, AVX2 };
+/// Instruction sets usable on this CPU, from the slowest to the fastest
+std::vector<InstructionSet> supported();
+InstructionSet current();
+/// Forces an instruction set (mostly for benchmarking): returns false if not supported by this CPU
+bool use(InstructionSet instruction_set);
+const char *name(InstructionSet instruction_set);
+
+/// Splits interleaved 8 bit pixels (1 or 3 channels) into one plane per channel
+void deinterleave(const uint8_t *source, std::size_t pixels, int channels, uint8_t * const *planes);
+/// Splits 16 bit pixels with `stride` components each (i.e. LibRaw RGBG images) into `channels` planes (1 or 3, at most stride)
+void deinterleave(const uint16_t *source, std::size_t pixels, int stride, int channels, uint16_t * const *planes);
+/// Converts 8 bit samples to 16 bit, scaling to the full range (0xFF becomes 0xFFFF)
+void widen(const uint8_t *source, std::size_t count, uint16_t *destination);
+/// Swaps the bytes of 16 bit samples in place, converting between little and big endian
+void swap_bytes(uint16_t *data, std::size_t count);
+/// Adds samples to 32 bit sums, for binning rows
+void accumulate(const uint8_t *source, std::size_t count, uint32_t *sums);
+void accumulate(const uint16_t *source, std::size_t count, uint32_t *sums);
+/// Calibrates samples in place: (sample - offset) * gain, rounded to the nearest integer and clamped to the sample range
+void calibrate(uint8_t *samples, std::size_t count, const float *offset, const float *gain);
+void calibrate(uint16_t *samples, std::size_t count, const float *offset, const float *gain);
+/**
+ * Adds samples to running means (Welford's algorithm), `counts` being the number of samples accepted for each mean.
+ * With `m2` (sums of squared differences from the mean) samples further than `sqrt(kappa2)` standard deviations
+ * from the mean are rejected, once the mean has at least two samples with some variance; `kappa2` 0 disables clipping.
+ */
+void stack(const uint8_t *source, std::size_t count, float *means, float *m2, float *counts, float kappa2);
+void stack(const uint16_t *source, std::size_t count, float *means, float *m2, float *counts, float kappa2);
+/// Converts float samples back to integers, rounded to the nearest and clamped to the sample range
+void narrow(const float *source, std::size_t count, uint8_t *destination);
+void narrow(const float *source, std::size_t count, uint16_t *destination);
+}
+}
+}
+
+#endif // INDI_GPHOTO_PIXELKERNELS_H
@@ -22,35 +22,140 @@
 #include "logger.h"
 #include "GPhoto++.h"
 #include "c++/containers_streams.h"
+#include "worker.h"
+#include "imagedecoder.h"
+#include "framepool.h"
+#include "widgetindex.h"
+#include "settingstransaction.h"
+#include "settingsschema.h"
+#include "detectedcameras.h"
+#include "statusnumbers.h"
+#include "liveview.h"
+#include "transferscheduler.h"
+#include "shotqueue.h"
+#include "parallel.h"
+#include <deque>
+#include <mutex>
+#include <set>
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <eventloop.h>
 using namespace std;
 using namespace GuLinux;
 using namespace INDI::GPhoto;
 using namespace GPhotoCPP;
 using namespace INDI::Properties;
+
+namespace {
+// Settings the camera refused are sent back to the clients with the value the camera holds, in alert state
+const char *rejected_message = "Camera did not accept the new value";
+
+template<size_t size> void copy_string(char (&destination)[size], const string &source)
+{
+    strncpy(destination, source.c_str(), size - 1);
+    destination[size - 1] = 0;
+}
+
+void send_rejected(const Identity &identity, const string &text)
+{
+    IText element{};
+    copy_string(element.name, identity.name);
+    copy_string(element.label, identity.label);
+    element.text = const_cast<char*>(text.c_str());
+    ITextVectorProperty vector{};
+    copy_string(vector.device, identity.device);
+    copy_string(vector.name, identity.name);
+    copy_string(vector.label, identity.label);
+    copy_string(vector.group, identity.group);
+    vector.p = identity.permission;
+    vector.s = IPS_ALERT;
+    vector.tp = &element;
+    vector.ntp = 1;
+    IDSetText(&vector, "%s", rejected_message);
+}
+
+void send_rejected(const Identity &identity, double value, const GPhotoCPP::Widget::RangeValue::Range &range)
+{
+    INumber element;
+    IUFillNumber(&element, identity.name.c_str(), identity.label.c_str(), "%g", range.min, range.max, range.increment, value);
+    INumberVectorProperty vector;
+    IUFillNumberVector(&vector, &element, 1, identity.device.c_str(), identity.name.c_str(), identity.label.c_str(), identity.group.c_str(), identity.permission, 60, IPS_ALERT);
+    IDSetNumber(&vector, "%s", rejected_message);
+}
+
+/// `choices` are the switch names, `current` the one which is on
+void send_rejected(const Identity &identity, const vector<string> &choices, const vector<string> &labels, const string &current)
+{
+    vector<ISwitch> elements(choices.size());
+    for(size_t index = 0; index < choices.size(); index++)
+        IUFillSwitch(&elements[index], choices[index].c_str(), labels[index].c_str(), choices[index] == current ? ISS_ON : ISS_OFF);
+    ISwitchVectorProperty vector;
+    IUFillSwitchVector(&vector, elements.data(), elements.size(), identity.device.c_str(), identity.name.c_str(), identity.label.c_str(), identity.group.c_str(), identity.permission, ISR_1OFMANY, 60, IPS_ALERT);
+    IDSetSwitch(&vector, "%s", rejected_message);
+}
+}
 class RealCamera::Private {
 public:
-    enum ImageType { RAW, JPEG };
-    Private(INDI::CCD *device, RealCamera *q);
+    Private(INDI::CCD *device, const DetectedCamera &detected, RealCamera *q);
     INDI::CCD *device;
     INDI::Utils::Logger log;
-    map<ImageType, GPhotoCPP::ReadImage::ptr> image_parsers;
     shared_ptr< GPhotoCPP::Logger > gphoto_logger;
     shared_ptr< GPhotoCPP::Driver > driver;
     GPhotoCPP::CameraPtr camera;
-    GPhotoCPP::Camera::ShotPtr current_shoot;
+    ShotQueue shots;
     Seconds mirror_lock = Seconds{0};
+    ImageDecoder::Mode decode_mode = ImageDecoder::FullImage;
+    int decode_threads = 0;
+    Calibration::Masters::ptr calibration;
+    FrameStatistics::Mode statistics_mode = FrameStatistics::Off;
+    bool native_preview = true;
     list<string> used_widget_names;
+    /// Serialises the camera accesses of the event loop and live view with the worker confirming the cached settings
+    mutex settings_mutex;
+    WidgetIndex<GPhotoCPP::Widget> widgets;
+    SettingsTransaction settings;
+    string model;
+    SettingsSchema schema;
+    bool schema_confirmed = false;
+    bool settings_changed = false;
+    set<string> loaded_groups;
+    struct Confirmation {
+        GPhotoCPP::WidgetPtr tree;
+        SettingsSchema schema;
+    };
+    future<Confirmation> confirmation;
+    uint64_t confirmation_commits = 0;
+    int confirmation_timer = -1;
+    void confirm_settings();
+    static void check_confirmation(void *self);
+    void add_setting(::Properties<string> &properties, const SettingsSchema::Setting &setting);
+    FramePool::ptr frame_pool;
+    StatusNumbers frame_pool_status;
+    void update_frame_pool_status();
     template<typename T> shared_ptr<T> widget_value(const string &name);
+    ShotQueue::Download download_image(const GPhotoCPP::Camera::ShotPtr &shot, ImageDecoder::Mode decode_mode, int decode_threads, const Frame::Region &region, const Calibration::Masters::ptr &calibration, FrameStatistics::Mode statistics_mode, bool with_preview);
+    unique_ptr<LiveView> live_view;
+    mutex previews_mutex;
+    deque<Preview::ptr> previews;
+    Notify frame_ready = []{};
+    Worker worker;
 private:
     RealCamera *q;
 };
 
-RealCamera::Private::Private(INDI::CCD* device, RealCamera* q)
+RealCamera::Private::Private(INDI::CCD* device, const DetectedCamera &detected, RealCamera* q)
     : device {device},
       log {device, "GPhotoCamera"},
-      image_parsers {{RAW, make_shared<GPhotoCPP::ReadRawImage>()}, {JPEG, make_shared<GPhotoCPP::ReadJPEGImage>()}},
+      shots {log},
+      widgets {[this] { lock_guard<mutex> lock(settings_mutex); return camera->widgets_settings(); }},
+      settings {log, [this] { lock_guard<mutex> lock(settings_mutex); camera->save_settings(); }, [this] { widgets.invalidate(); }},
+      frame_pool {make_shared<FramePool>()},
+      frame_pool_status {device, "FRAME_POOL", "Frame Buffers", "Debug"},
       q{q}
 {
+    frame_pool_status.add("FRAME_POOL_HITS", "Hits").add("FRAME_POOL_MISSES", "Misses")
+        .add("FRAME_POOL_SPARES", "Spare buffers").add("FRAME_POOL_SPARE_MB", "Spare memory (MB)", "%.1f");
     gphoto_logger = make_shared<GPhotoCPP::Logger>([=](const string &m, GPhotoCPP::Logger::Level l) {
         static map<GPhotoCPP::Logger::Level, INDI::Logger::VerbosityLevel> levels {
             {GPhotoCPP::Logger::ERROR, INDI::Logger::DBG_ERROR },
@@ -62,7 +167,17 @@ RealCamera::Private::Private(INDI::CCD* device, RealCamera* q)
         DEBUGDEVICE(device->getDeviceName(), levels[l], m.c_str());
     });
     driver = make_shared<GPhotoCPP::Driver>(gphoto_logger);
-    camera =  driver->autodetect();
+    if(detected.port.empty()) {
+        camera = driver->autodetect();
+        auto detected_cameras = detect_cameras();
+        model = detected_cameras.empty() ? string{} : detected_cameras.front().model;
+    } else {
+        // Autodetection would open the first camera on the bus, whatever the device
+        for(auto factory: driver->cameras())
+            if(factory->port() == detected.port)
+                camera = factory->camera();
+        model = detected.model;
+    }
     if(! camera)
         throw std::runtime_error("Unable to find camera");
     used_widget_names = make_stream(list<GPhotoCPP::WidgetPtr>{camera->settings().iso_widget(), camera->settings().format_widget()})
@@ -72,193 +187,450 @@ RealCamera::Private::Private(INDI::CCD* device, RealCamera* q)
 }
 
 
-RealCamera::RealCamera(INDI::CCD* device) : dptr(device, this)
+RealCamera::RealCamera(INDI::CCD* device, const DetectedCamera &detected) : dptr(device, detected, this)
 {
 }
 
 RealCamera::~RealCamera()
 {
+    // Value checks refer to the camera, so pending settings are committed while it is still whole
+    d->settings.commit();
+    if(d->confirmation_timer != -1)
+        IERmTimer(d->confirmation_timer);
 }
 
 vector< string > RealCamera::available_iso()
 {
+    lock_guard<mutex> lock(d->settings_mutex);
     return d->camera->settings().iso_choices();
 }
 
 string RealCamera::current_iso()
 {
+    lock_guard<mutex> lock(d->settings_mutex);
     return d->camera->settings().iso();
 }
 
 bool RealCamera::set_iso(const string& iso)
 {
-    d->camera->settings().set_iso(iso);
-    d->camera->save_settings();
-    return current_iso() == iso;
+    {
+        lock_guard<mutex> lock(d->settings_mutex);
+        d->camera->settings().set_iso(iso);
+    }
+    d->settings.changed("ISO", [this, iso] { return current_iso() == iso; });
+    return true;
 }
 
 vector< string > RealCamera::available_formats()
 {
+  lock_guard<mutex> lock(d->settings_mutex);
   return d->camera->settings().format_choices();
 }
 
 string RealCamera::current_format()
 {
+  lock_guard<mutex> lock(d->settings_mutex);
   return d->camera->settings().format();
 }
 
 bool RealCamera::set_format(const string& format)
 {
-    d->camera->settings().set_format(format);
-    d->camera->save_settings();
-    return current_format() == format;
+    {
+        lock_guard<mutex> lock(d->settings_mutex);
+        d->camera->settings().set_format(format);
+    }
+    d->settings.changed("FORMAT", [this, format] { return current_format() == format; });
+    d->frame_pool->clear();
+    return true;
 }
 
 
 
 
-bool RealCamera::shoot(INDI::GPhoto::Camera::Seconds seconds)
+void RealCamera::set_decode_mode(ImageDecoder::Mode mode)
+{
+    d->decode_mode = mode;
+}
+
+void RealCamera::set_decode_threads(int threads)
+{
+    d->decode_threads = threads;
+}
+
+void RealCamera::set_calibration(const Calibration::Masters::ptr& calibration)
+{
+    d->calibration = calibration;
+}
+
+void RealCamera::set_statistics_mode(FrameStatistics::Mode mode)
+{
+    d->statistics_mode = mode;
+}
+
+bool RealCamera::shoot(INDI::GPhoto::Camera::Seconds seconds, const Frame::Region &region)
 {
-    if(current_format().find('+') != string::npos) {
-      d->log.error() << "Error! current format " << current_format() << 
-	" is not supported. Please select only a single format (RAW or JPEG), not composite formats (RAW+JPEG)";
-      return false;
-    }
     bool mirror_lock_enabled = d->mirror_lock > Seconds{0};
     d->log.debug() << "mirrorlock secs: " << d->mirror_lock.count() << ", enabled: " << mirror_lock_enabled;
-    d->current_shoot = d->camera->control().shoot(seconds, mirror_lock_enabled, d->mirror_lock);
-    return d->current_shoot.operator bool();
+    if(! can_shoot()) {
+        d->log.error() << "Camera is still exposing the previous frame";
+        return false;
+    }
+    if(d->live_view) {
+        d->log.error() << "Cannot shoot while live view is running";
+        return false;
+    }
+    d->settings.commit();
+    GPhotoCPP::Camera::ShotPtr shot;
+    {
+        // The worker may still be reading the settings tree: the shot returns before its transfer, so the lock is short
+        lock_guard<mutex> lock(d->settings_mutex);
+        shot = d->camera->control().shoot(seconds, mirror_lock_enabled, d->mirror_lock);
+    }
+    if(! shot)
+        return false;
+    // Transfer and decoding are run by the worker thread, shoot_status() reports Finished once the oldest image is ready.
+    // Meanwhile, a new shot can be started as soon as the camera finished exposing.
+    // With composite formats (RAW+JPEG) a JPEG preview is sent as soon as the file is transferred, before the full decoding.
+    bool with_preview = current_format().find('+') != string::npos || (d->decode_mode == ImageDecoder::Native && d->native_preview);
+    d->shots.push(shot->duration(), [shot] { return shot->elapsed(); },
+        d->worker.queue<ShotQueue::Download>(bind(&Private::download_image, d.get(), shot, d->decode_mode, d->decode_threads, region, d->calibration, d->statistics_mode, with_preview), d->frame_ready));
+    return true;
+}
+
+bool RealCamera::can_shoot() const
+{
+    return d->shots.can_shoot();
+}
+
+void RealCamera::abort()
+{
+    d->shots.abort();
+}
+
+size_t RealCamera::frames_in_flight() const
+{
+    return d->shots.size();
 }
 
 INDI::GPhoto::Camera::ShootStatus RealCamera::shoot_status() const
 {
-    if(! d->current_shoot )
-        return {Camera::ShootStatus::Idle};
-    if( d->current_shoot->elapsed() >= d->current_shoot->duration() )
-        return {Camera::ShootStatus::Finished, d->current_shoot->elapsed(), Seconds{0} };
-    return {Camera::ShootStatus::Finished, d->current_shoot->elapsed(), d->current_shoot->duration() - d->current_shoot->elapsed() };
+    return d->shots.status();
+}
+
+INDI::GPhoto::Camera::FrameTimings RealCamera::last_frame_timings() const
+{
+    return d->shots.last_frame_timings();
+}
+
+FrameStatistics::Result RealCamera::last_frame_statistics() const
+{
+    return d->shots.last_frame_statistics();
+}
+
+string RealCamera::bayer_pattern() const
+{
+    return d->shots.bayer_pattern();
+}
+
+INDI::GPhoto::Camera::Preview::ptr RealCamera::take_preview()
+{
+    lock_guard<mutex> lock(d->previews_mutex);
+    if(d->previews.empty())
+        return {};
+    auto preview = d->previews.front();
+    d->previews.pop_front();
+    return preview;
+}
+
+bool RealCamera::start_live_view()
+{
+    if(d->shots.size() > 0) {
+        d->log.error() << "Cannot start live view while shooting";
+        return false;
+    }
+    d->settings.commit();
+    auto camera = d->camera;
+    mutex &settings_mutex = d->settings_mutex;
+    // Preview capture blocks until the camera has a new live view frame, so frames are grabbed at the camera native rate
+    d->live_view.reset(new LiveView{[camera, &settings_mutex](Frame &frame) {
+        GPhotoCPP::CameraFilePtr file;
+        {
+            // Grabbing in a loop would hog the bus shared with the other cameras
+            TransferScheduler::Slot slot;
+            lock_guard<mutex> lock(settings_mutex);
+            file = camera->control().preview();
+        }
+        const vector<uint8_t> &data = file->data();
+        JPEGDecoder{}.decode(data.data(), data.size(), frame);
+    }});
+    return true;
+}
+
+void RealCamera::stop_live_view()
+{
+    d->live_view.reset();
+}
+
+Frame::ptr RealCamera::live_view_frame()
+{
+    if(! d->live_view)
+        return {};
+    auto error = d->live_view->error();
+    if(! error.empty()) {
+        d->live_view.reset();
+        throw runtime_error("Live view stopped: " + error);
+    }
+    return d->live_view->take_frame();
+}
+
+LiveView::Stats RealCamera::live_view_stats() const
+{
+    return d->live_view ? d->live_view->stats() : LiveView::Stats{0, 0, 0};
+}
+
+ShotQueue::Download RealCamera::Private::download_image(const GPhotoCPP::Camera::ShotPtr &shot, ImageDecoder::Mode decode_mode, int decode_threads, const Frame::Region &region, const Calibration::Masters::ptr &calibration, FrameStatistics::Mode statistics_mode, bool with_preview)
+{
+    Parallel::set_threads(decode_threads);
+    // Still image transfers are run by libgphoto-cpp on its own thread, so they are not scheduled here:
+    // a slot held while waiting for them would only hold back the other cameras, exposures included
+    GPhotoCPP::CameraFilePtr file = shot->camera_file().get();
+    auto transferred = chrono::steady_clock::now();
+    // The camera is done exposing: a burst can start the next shot
+    frame_ready();
+    const vector<uint8_t> &original_data = file->data();
+    auto decoder = ImageDecoder::for_file(file->file(), decode_mode);
+    // A JPEG file is its own preview
+    auto extension = ImageDecoder::extension(file->file());
+    if(decode_mode == ImageDecoder::Native && (extension == "jpg" || extension == "jpeg"))
+        with_preview = false;
+    if(with_preview) {
+        auto preview = make_shared<Preview>(Preview{decoder->jpeg_preview(original_data.data(), original_data.size()), ".jpeg"});
+        if(! preview->data.empty()) {
+            lock_guard<mutex> lock(previews_mutex);
+            previews.push_back(preview);
+        }
+        frame_ready();
+    }
+    if(decode_mode == ImageDecoder::Native)
+        return {file->file(), {}, transferred, transferred, original_data.size(), shared_ptr<const vector<uint8_t>>{file, &original_data}};
+    auto frame = make_shared<Frame>(frame_pool);
+    frame->set_calibration(calibration);
+    if(statistics_mode != FrameStatistics::Off)
+        frame->set_statistics(make_shared<FrameStatistics>(statistics_mode));
+    decoder->decode(original_data.data(), original_data.size(), *frame, region);
+    return {file->file(), frame, transferred, chrono::steady_clock::now(), original_data.size()};
+}
+
+void RealCamera::set_frame_ready_callback(const Notify& frame_ready)
+{
+    d->frame_ready = frame_ready;
 }
 
 INDI::GPhoto::Camera::WriteImage RealCamera::write_image() const
 {
     return [&](CCDChip &chip) {
-        d->current_shoot->camera_file().wait();
-        d->log.session() << "Exposure complete, downloading image...";
-        GPhotoCPP::CameraFilePtr  file = d->current_shoot->camera_file().get();
-        d->current_shoot.reset();
-        string extension = make_stream(file->file().substr(file->file().rfind(".")+1)).transform<string>(::tolower);
-        auto image_parser = (extension == "jpg" || extension == "jpeg") ? d->image_parsers[Private::JPEG] : d->image_parsers[Private::RAW];
-        d->log.debug() << "Image filename" << file->file() << ", extension: " << extension;
-        vector<uint8_t> original_data = file->data();
-        GPhotoCPP::ReadImage::Image image;
-        try {
-            image = image_parser->read(original_data, file->file());
-        } catch(std::exception &e) {
-            d->log.error() << "Exposure failed to parse image: " << e.what();
+        if(! d->shots.write_image(chip))
             return false;
-        }
-        d->log.debug() << "Copying image: w=" << image.w << ", h=" << image.h << ", bpp=" << image.bpp << ", channels=" << image.channels.size();
-        chip.setFrame(0, 0, image.w, image.h);
-        chip.setResolution(image.w, image.h);
-        chip.setNAxis(image.channels.size() == 3 ? 3 : 2);
-        chip.setBPP(image.bpp);
-
-        typedef std::pair<GPhotoCPP::ReadImage::Image::Channel, GPhotoCPP::ReadImage::Image::Pixels> channel;
-        chip.setFrameBufferSize(make_stream(image.channels).transform<list<size_t>>([](const channel &c) {
-            return c.second.size();
-        }).accumulate(), true);
-        size_t data_begin = 0;
-        for(auto c: image.channels) {
-            std::move(c.second.begin(), c.second.end(), chip.getFrameBuffer() + data_begin);
-            data_begin += c.second.size();
-        }
-        chip.setImageExtension("fits");
+        d->update_frame_pool_status();
         return true;
     };
 }
 
+void RealCamera::Private::update_frame_pool_status()
+{
+    auto stats = frame_pool->stats();
+    frame_pool_status.set("FRAME_POOL_HITS", stats.hits);
+    frame_pool_status.set("FRAME_POOL_MISSES", stats.misses);
+    frame_pool_status.set("FRAME_POOL_SPARES", stats.spare_buffers);
+    frame_pool_status.set("FRAME_POOL_SPARE_MB", static_cast<double>(stats.spare_bytes) / 1024. / 1024.);
+    frame_pool_status.send();
+}
+
 template<typename T> shared_ptr<T> RealCamera::Private::widget_value(const string& name)
 {
-  return camera->widgets_settings()->child_by_name(name)->get<T>();
+  auto widget = widgets.find(name);
+  if(! widget)
+    throw runtime_error("Camera setting not found: " + name);
+  return widget->get<T>();
 }
 
 
-void RealCamera::setup_properties(::Properties< std::string >& properties)
+void RealCamera::Private::add_setting(::Properties<string>& properties, const SettingsSchema::Setting& setting)
 {
     typedef GPhotoCPP::Widget Widget;
-    typedef const GPhotoCPP::WidgetPtr& WidgetPtr;
-    auto make_identity = [this](WidgetPtr w) {
-        return Identity {d->device->getDeviceName(), w->name(), w->label(), w->parent()->label(), w->access() == GPhotoCPP::Widget::ReadOnly ? IP_RO : IP_RW};
-    };
-    map<GPhotoCPP::Widget::Type, function<void(WidgetPtr)>> supported_types {
-        {   Widget::String, [&](WidgetPtr w) {
-		auto wv = [=] { return d->widget_value<Widget::StringValue>(w->name()); };
-                auto widget_value = wv();
-                properties.add_text(w->name(), d->device, make_identity(w), [=](const vector<Text::UpdateArgs> &u) {
-                    string value = get<0>(u[0]);
-                    wv()->set(value);
-                    d->camera->save_settings();
-                    return wv()->get() == value;
-                })
-                .add(w->name(), w->label(), widget_value->get().c_str());
-            }
-        },
-        {   Widget::Range, [&](WidgetPtr w) {
-		auto wv = [=] { return d->widget_value<Widget::RangeValue>(w->name()); };
-		auto widget_value = wv();
-                properties.add_number(w->name(), d->device, make_identity(w), [=](const vector<Number::UpdateArgs> &u) {
-                    auto value= get<0>(u[0]);
-                    wv()->set(value);
-                    d->camera->save_settings();
-                    return wv()->get() == value;
-                })
-                .add(w->name(), w->label(), widget_value->range().min, widget_value->range().max, widget_value->range().increment, widget_value->get());
-            }
-        },
-        {   Widget::Toggle, [&](WidgetPtr w) {
-		auto wv = [=] { return d->widget_value<Widget::ToggleValue>(w->name()); };
-		bool is_on = wv()->get();
-                properties.add_switch(w->name(), d->device, make_identity(w), ISR_1OFMANY, [=](const vector<Switch::UpdateArgs> &u) {
-                    bool is_on = get<1>(u[0]) == "on";
-		    wv()->set(is_on);
-                    d->camera->save_settings();
-                    return wv()->get() == is_on;
-                })
-                .add("on", "On", is_on ? ISS_ON : ISS_OFF)
-                .add("off", "Off", is_on ? ISS_OFF : ISS_ON);
-            }
-        },
-        {   Widget::Menu, [&](WidgetPtr w) {
-		auto wv = [=] { return d->widget_value<Widget::MenuValue>(w->name()); };
-                auto widget_value = wv();
-                auto &sw = properties.add_switch(w->name(), d->device, make_identity(w), ISR_1OFMANY, [=](const vector<Switch::UpdateArgs> &u) {
-                    auto current_text = get<1>(*make_stream(u).first(Switch::On));
-                    wv()->set(current_text);
-                    d->camera->save_settings();
-                    return wv()->get() == current_text;
-                });
-		auto current_choice = widget_value->get();
-		for(auto choice: widget_value->choices()) {
-		  sw.add(choice, choice, choice == current_choice ? ISS_ON : ISS_OFF);
-		}
-            }
-        },
-        { Widget::Button, {} },
-        { Widget::Date, {} },
-        { Widget::Window, {} },
-        { Widget::Section, {} },
-    };
-    auto format_widget = d->camera->settings().format_widget();
-    auto iso_widget = d->camera->settings().iso_widget();
-    auto widgets = make_stream(d->camera->widgets_settings()->all_children())
-    .filter([&](WidgetPtr w) {
-        return supported_types[w->type()] && ! make_stream(d->used_widget_names).contains(w->name());
-    })
-    .for_each([&](WidgetPtr w) {
-        supported_types[w->type()](w);
+    Identity identity{device->getDeviceName(), setting.name, setting.label, setting.group, setting.read_only ? IP_RO : IP_RW};
+    const string name = setting.name;
+    switch(setting.type) {
+        case Widget::String:
+            properties.add_text(name, device, identity, [=](const vector<Text::UpdateArgs> &u) {
+                string value = get<0>(u[0]);
+                widget_value<Widget::StringValue>(name)->set(value);
+                settings.changed(name, [=] { return widget_value<Widget::StringValue>(name)->get() == value; },
+                    [=] { send_rejected(identity, widget_value<Widget::StringValue>(name)->get()); });
+                return true;
+            })
+            .add(name, setting.label, setting.text.c_str());
+            break;
+        case Widget::Range:
+            properties.add_number(name, device, identity, [=](const vector<Number::UpdateArgs> &u) {
+                auto value= get<0>(u[0]);
+                auto range_value = widget_value<Widget::RangeValue>(name);
+                auto range = range_value->range();
+                if(value < range.min || value > range.max)
+                    return false;
+                range_value->set(value);
+                settings.changed(name, [=] { return widget_value<Widget::RangeValue>(name)->get() == value; },
+                    [=] { send_rejected(identity, widget_value<Widget::RangeValue>(name)->get(), range); });
+                return true;
+            })
+            .add(name, setting.label, setting.min, setting.max, setting.step, setting.value);
+            break;
+        case Widget::Toggle:
+            properties.add_switch(name, device, identity, ISR_1OFMANY, [=](const vector<Switch::UpdateArgs> &u) {
+                auto on_switch = make_stream(u).first(Switch::On);
+                if(! on_switch)
+                    return false;
+                bool is_on = get<1>(*on_switch) == "on";
+                widget_value<Widget::ToggleValue>(name)->set(is_on);
+                settings.changed(name, [=] { return widget_value<Widget::ToggleValue>(name)->get() == is_on; },
+                    [=] { send_rejected(identity, {"on", "off"}, {"On", "Off"}, widget_value<Widget::ToggleValue>(name)->get() ? "on" : "off"); });
+                return true;
+            })
+            .add("on", "On", setting.value ? ISS_ON : ISS_OFF)
+            .add("off", "Off", setting.value ? ISS_OFF : ISS_ON);
+            break;
+        case Widget::Menu: {
+            const auto choices = setting.choices;
+            auto &sw = properties.add_switch(name, device, identity, ISR_1OFMANY, [=](const vector<Switch::UpdateArgs> &u) {
+                auto on_switch = make_stream(u).first(Switch::On);
+                if(! on_switch)
+                    return false;
+                auto current_text = get<1>(*on_switch);
+                if(find(choices.begin(), choices.end(), current_text) == choices.end())
+                    return false;
+                widget_value<Widget::MenuValue>(name)->set(current_text);
+                settings.changed(name, [=] { return widget_value<Widget::MenuValue>(name)->get() == current_text; },
+                    [=] { send_rejected(identity, choices, choices, widget_value<Widget::MenuValue>(name)->get()); });
+                return true;
+            });
+            for(auto choice: setting.choices)
+                sw.add(choice, choice, choice == setting.text ? ISS_ON : ISS_OFF);
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+void RealCamera::Private::confirm_settings()
+{
+    auto excluded = used_widget_names;
+    confirmation_commits = settings.commits();
+    confirmation = worker.queue<Confirmation>([this, excluded] {
+        GPhotoCPP::WidgetPtr tree;
+        {
+            lock_guard<mutex> lock(settings_mutex);
+            tree = camera->widgets_settings();
+        }
+        auto children = tree->all_children();
+        return Confirmation{tree, SettingsSchema::read({children.begin(), children.end()}, excluded)};
     });
-    if(d->camera->settings().needs_serial_port()) {
+    confirmation_timer = IEAddTimer(100, &Private::check_confirmation, this);
+}
+
+void RealCamera::Private::check_confirmation(void* self)
+{
+    auto d = reinterpret_cast<RealCamera::Private*>(self);
+    d->confirmation_timer = -1;
+    if(d->confirmation.wait_for(chrono::seconds{0}) != future_status::ready) {
+        d->confirmation_timer = IEAddTimer(100, &Private::check_confirmation, self);
+        return;
+    }
+    try {
+        auto confirmation = d->confirmation.get();
+        // Settings saved meanwhile may not be in the tree read by the worker
+        if(d->settings.pending() || d->settings.commits() != d->confirmation_commits) {
+            d->confirm_settings();
+            return;
+        }
+        d->widgets.adopt(confirmation.tree);
+        d->schema_confirmed = true;
+        if(confirmation.schema == d->schema)
+            return;
+        d->log.debug() << "Camera settings differ from the cached ones, updating properties";
+        d->schema = confirmation.schema;
+        d->schema.save(SettingsSchema::cache_file(d->model));
+        d->settings_changed = true;
+    } catch(std::exception &e) {
+        d->log.error() << "Error reading camera settings: " << e.what();
+    }
+}
+
+bool RealCamera::settings_changed() const
+{
+    return d->settings_changed;
+}
+
+void RealCamera::setup_properties(::Properties< std::string >& properties)
+{
+    // Properties are defined from the settings cached for this camera model, while the actual settings are read in background:
+    // if they turn out to be different, settings_changed() asks for the properties to be defined again.
+    d->settings_changed = false;
+    if(! d->schema_confirmed && ! d->confirmation.valid()) {
+        if(d->schema.load(SettingsSchema::cache_file(d->model))) {
+            d->confirm_settings();
+        } else {
+            d->log.debug() << "No cached settings for " << d->model << ", reading them from the camera";
+            d->schema = SettingsSchema::read(d->widgets.all(), d->used_widget_names);
+            d->schema_confirmed = true;
+            d->schema.save(SettingsSchema::cache_file(d->model));
+        }
+    }
+    // Rarely used groups have many settings: their properties are defined on request only
+    static const set<string> lazy_groups{"Camera Status Information", "Other PTP Device Properties", "Other Settings"};
+    map<string, string> lazy_switches;
+    for(auto &setting: d->schema.settings) {
+        if(! lazy_groups.count(setting.group)) {
+            d->add_setting(properties, setting);
+            continue;
+        }
+        string switch_name = setting.group;
+        replace_if(switch_name.begin(), switch_name.end(), [](char c) { return ! isalnum(static_cast<unsigned char>(c)); }, '_');
+        lazy_switches[switch_name] = setting.group;
+    }
+    if(! lazy_switches.empty()) {
+        auto &groups = properties.add_switch("SETTINGS_GROUPS", d->device, {d->device->getDeviceName(), "SETTINGS_GROUPS", "Show settings", "Main Control"}, ISR_NOFMANY,
+                                             [this, &properties, lazy_switches](const vector<Switch::UpdateArgs> &states) {
+            for(auto state: states) {
+                string group = lazy_switches.at(get<1>(state));
+                bool loaded = d->loaded_groups.count(group);
+                // Once defined, properties stay until disconnection
+                if(get<0>(state) != ISS_ON && loaded)
+                    return false;
+                if(get<0>(state) != ISS_ON || loaded)
+                    continue;
+                for(auto &setting: d->schema.settings)
+                    if(setting.group == group)
+                        d->add_setting(properties, setting);
+                d->loaded_groups.insert(group);
+            }
+            properties.register_unregistered_properties();
+            return true;
+        });
+        for(auto lazy_switch: lazy_switches)
+            groups.add(lazy_switch.first, lazy_switch.second, d->loaded_groups.count(lazy_switch.second) ? ISS_ON : ISS_OFF);
+        for(auto &setting: d->schema.settings)
+            if(d->loaded_groups.count(setting.group))
+                d->add_setting(properties, setting);
+    }
+    bool needs_serial_port;
+    {
+        lock_guard<mutex> lock(d->settings_mutex);
+        needs_serial_port = d->camera->settings().needs_serial_port();
+    }
+    if(needs_serial_port) {
       properties.add_text("serial_port", d->device, {d->device->getDeviceName(), "trigger", "Trigger", "Main Control", IP_RW}, [=](const vector<Text::UpdateArgs> &u) {
+	lock_guard<mutex> lock(d->settings_mutex);
 	d->camera->settings().set_serial_port(get<0>(u[0]));
 	return true;
       }).add("serial_port_value", "Serial Port", "");
@@ -268,4 +640,13 @@ void RealCamera::setup_properties(::Properties< std::string >& properties)
       d->mirror_lock = Seconds{get<0>(u[0])};
       return true;
     }).add("mirrorlock_sec", "seconds", 0, 10, 1, d->mirror_lock.count(), "%1.0f");
+    properties.add_switch("NATIVE_PREVIEW", d->device, {d->device->getDeviceName(), "NATIVE_PREVIEW", "Preview with native files", "Image Settings"}, ISR_1OFMANY, [=](const vector<Switch::UpdateArgs> &u) {
+        auto on_switch = make_stream(u).first(Switch::On);
+        if(! on_switch)
+            return false;
+        d->native_preview = get<1>(*on_switch) == "NATIVE_PREVIEW_ON";
+        return true;
+    }).add("NATIVE_PREVIEW_ON", "On", d->native_preview ? ISS_ON : ISS_OFF)
+      .add("NATIVE_PREVIEW_OFF", "Off", d->native_preview ? ISS_OFF : ISS_ON);
+    d->frame_pool_status.define();
 }
@@ -22,6 +22,7 @@
 #define REALCAMERA_H
 
 #include "camera.h"
+#include "detectedcameras.h"
 #include "c++/dptr.h"
 #include <indiccd.h>
 namespace INDI {
@@ -29,7 +30,8 @@ namespace GPhoto {
 class RealCamera : public INDI::GPhoto::Camera
 {
 public:
-    RealCamera(INDI::CCD *device);
+    /// Opens the camera on the given port, or the first camera found when no port is given
+    RealCamera(INDI::CCD *device, const DetectedCamera &detected = {});
     ~RealCamera();
     virtual std::vector< std::string > available_iso();
     virtual std::string current_iso();
@@ -37,10 +39,27 @@ public:
     virtual std::vector< std::string > available_formats();
     virtual std::string current_format();
     virtual bool set_format(const std::string& format);
+    virtual void set_decode_mode(ImageDecoder::Mode mode);
+    virtual void set_decode_threads(int threads);
+    virtual void set_calibration(const Calibration::Masters::ptr &calibration);
+    virtual void set_statistics_mode(FrameStatistics::Mode mode);
     
-    virtual bool shoot(Seconds seconds);
+    virtual bool shoot(Seconds seconds, const Frame::Region &region);
+    virtual bool can_shoot() const;
+    virtual void abort();
+    virtual std::size_t frames_in_flight() const;
     virtual ShootStatus shoot_status() const;
+    virtual FrameTimings last_frame_timings() const;
+    virtual FrameStatistics::Result last_frame_statistics() const;
+    virtual std::string bayer_pattern() const;
+    virtual Preview::ptr take_preview();
+    virtual bool start_live_view();
+    virtual void stop_live_view();
+    virtual Frame::ptr live_view_frame();
+    virtual LiveView::Stats live_view_stats() const;
     virtual WriteImage write_image() const;
+    virtual void set_frame_ready_callback(const Notify &frame_ready);
+    virtual bool settings_changed() const;
     virtual void setup_properties(INDI::Properties::Properties< std::string >& properties);
 private:
   D_PTR;
@@ -0,0 +1,288 @@
+/*
+ * Driver type: GPhoto Camera INDI Driver
+ *
+ * Copyright (C) 2016 Marco Gulino (marco AT gulinux.net)
+ *
+ * This library is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#include "replaycamera.h"
+#include "logger.h"
+#include "c++/containers_streams.h"
+#include "worker.h"
+#include "imagedecoder.h"
+#include "framepool.h"
+#include "shotqueue.h"
+#include "parallel.h"
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <thread>
+#include <dirent.h>
+
+using namespace std;
+using namespace INDI::GPhoto;
+using namespace INDI::Properties;
+
+class ReplayCamera::Private {
+public:
+    struct Recording {
+        string filename;
+        Seconds exposure;
+        Seconds transfer;
+    };
+    Private(INDI::CCD *device, const string &directory, ReplayCamera *q);
+    INDI::CCD *device;
+    INDI::Utils::Logger log;
+    string directory;
+    vector<Recording> recordings;
+    size_t next_recording = 0;
+    bool realistic = true;
+    ShotQueue shots;
+    ImageDecoder::Mode decode_mode = ImageDecoder::FullImage;
+    int decode_threads = 0;
+    Calibration::Masters::ptr calibration;
+    FrameStatistics::Mode statistics_mode = FrameStatistics::Off;
+    FramePool::ptr frame_pool;
+    Notify frame_ready = []{};
+    Worker worker;
+    void read_recordings();
+    ShotQueue::Download download_image(const Recording &recording, chrono::steady_clock::time_point transfer_done, ImageDecoder::Mode decode_mode, int decode_threads, const Frame::Region &region, const Calibration::Masters::ptr &calibration, FrameStatistics::Mode statistics_mode);
+private:
+    ReplayCamera *q;
+};
+
+ReplayCamera::Private::Private(INDI::CCD* device, const string& directory, ReplayCamera* q)
+    : device{device}, log{device, "ReplayCamera"}, directory{directory}, shots{log}, frame_pool{make_shared<FramePool>()}, q{q}
+{
+}
+
+ReplayCamera::ReplayCamera(INDI::CCD* device, const string& directory) : dptr(device, directory, this)
+{
+    d->read_recordings();
+    if(d->recordings.empty())
+        throw runtime_error("No recorded files found in " + directory);
+    d->log.debug() << "Replaying " << d->recordings.size() << " files from " << directory;
+}
+
+ReplayCamera::~ReplayCamera()
+{
+}
+
+void ReplayCamera::Private::read_recordings()
+{
+    ifstream manifest{directory + "/manifest.txt"};
+    if(manifest) {
+        string line;
+        while(getline(manifest, line)) {
+            if(line.empty() || line[0] == '#')
+                continue;
+            istringstream fields{line};
+            Recording recording;
+            double exposure = 0, transfer = 0;
+            if(! (fields >> recording.filename))
+                continue;
+            fields >> exposure >> transfer;
+            recording.exposure = Seconds{exposure};
+            recording.transfer = Seconds{transfer};
+            recordings.push_back(recording);
+        }
+        return;
+    }
+    DIR *dir = opendir(directory.c_str());
+    if(! dir)
+        throw runtime_error("Unable to open replay directory " + directory);
+    while(auto entry = readdir(dir)) {
+        string filename = entry->d_name;
+        if(filename[0] != '.')
+            recordings.push_back({filename, Seconds{0}, Seconds{0}});
+    }
+    closedir(dir);
+    sort(recordings.begin(), recordings.end(), [](const Recording &a, const Recording &b) { return a.filename < b.filename; });
+}
+
+vector< string > ReplayCamera::available_iso()
+{
+    return {"Recorded"};
+}
+
+string ReplayCamera::current_iso()
+{
+    return "Recorded";
+}
+
+bool ReplayCamera::set_iso(const string& iso)
+{
+    return iso == current_iso();
+}
+
+vector< string > ReplayCamera::available_formats()
+{
+    return {"Recorded"};
+}
+
+string ReplayCamera::current_format()
+{
+    return "Recorded";
+}
+
+bool ReplayCamera::set_format(const string& format)
+{
+    return format == current_format();
+}
+
+void ReplayCamera::set_decode_mode(ImageDecoder::Mode mode)
+{
+    d->decode_mode = mode;
+}
+
+void ReplayCamera::set_decode_threads(int threads)
+{
+    d->decode_threads = threads;
+}
+
+void ReplayCamera::set_calibration(const Calibration::Masters::ptr& calibration)
+{
+    d->calibration = calibration;
+}
+
+void ReplayCamera::set_statistics_mode(FrameStatistics::Mode mode)
+{
+    d->statistics_mode = mode;
+}
+
+bool ReplayCamera::shoot(Seconds seconds, const Frame::Region& region)
+{
+    if(! can_shoot()) {
+        d->log.error() << "Camera is still exposing the previous frame";
+        return false;
+    }
+    auto recording = d->recordings[d->next_recording];
+    d->next_recording = (d->next_recording + 1) % d->recordings.size();
+    auto started = chrono::steady_clock::now();
+    Seconds exposure = ! d->realistic ? Seconds{0} : (recording.exposure > Seconds{0} ? recording.exposure : seconds);
+    auto transfer_done = started + chrono::duration_cast<chrono::steady_clock::duration>(exposure + (d->realistic ? recording.transfer : Seconds{0}));
+    d->shots.push(exposure, [started] { return Seconds{chrono::steady_clock::now() - started}; },
+        d->worker.queue<ShotQueue::Download>(bind(&Private::download_image, d.get(), recording, transfer_done, d->decode_mode, d->decode_threads, region, d->calibration, d->statistics_mode), d->frame_ready));
+    return true;
+}
+
+bool ReplayCamera::can_shoot() const
+{
+    return d->shots.can_shoot();
+}
+
+void ReplayCamera::abort()
+{
+    d->shots.abort();
+}
+
+size_t ReplayCamera::frames_in_flight() const
+{
+    return d->shots.size();
+}
+
+INDI::GPhoto::Camera::ShootStatus ReplayCamera::shoot_status() const
+{
+    return d->shots.status();
+}
+
+INDI::GPhoto::Camera::FrameTimings ReplayCamera::last_frame_timings() const
+{
+    return d->shots.last_frame_timings();
+}
+
+FrameStatistics::Result ReplayCamera::last_frame_statistics() const
+{
+    return d->shots.last_frame_statistics();
+}
+
+string ReplayCamera::bayer_pattern() const
+{
+    return d->shots.bayer_pattern();
+}
+
+INDI::GPhoto::Camera::Preview::ptr ReplayCamera::take_preview()
+{
+    return {};
+}
+
+bool ReplayCamera::start_live_view()
+{
+    d->log.error() << "Live view can't be replayed";
+    return false;
+}
+
+void ReplayCamera::stop_live_view()
+{
+}
+
+Frame::ptr ReplayCamera::live_view_frame()
+{
+    return {};
+}
+
+LiveView::Stats ReplayCamera::live_view_stats() const
+{
+    return {0, 0, 0};
+}
+
+ShotQueue::Download ReplayCamera::Private::download_image(const Recording &recording, chrono::steady_clock::time_point transfer_done, ImageDecoder::Mode decode_mode, int decode_threads, const Frame::Region &region, const Calibration::Masters::ptr &calibration, FrameStatistics::Mode statistics_mode)
+{
+    Parallel::set_threads(decode_threads);
+    // Reading the file stands for the transfer from the camera, the recorded transfer time being waited for on top of it
+    this_thread::sleep_until(transfer_done);
+    ifstream file{directory + "/" + recording.filename, ios::binary};
+    if(! file)
+        throw runtime_error("Unable to read recorded file " + recording.filename);
+    vector<uint8_t> data{istreambuf_iterator<char>{file}, istreambuf_iterator<char>{}};
+    auto transferred = chrono::steady_clock::now();
+    if(decode_mode == ImageDecoder::Native)
+        return {recording.filename, {}, transferred, transferred, data.size(), make_shared<const vector<uint8_t>>(move(data))};
+    auto decoder = ImageDecoder::for_file(recording.filename, decode_mode);
+    auto frame = make_shared<Frame>(frame_pool);
+    frame->set_calibration(calibration);
+    if(statistics_mode != FrameStatistics::Off)
+        frame->set_statistics(make_shared<FrameStatistics>(statistics_mode));
+    decoder->decode(data.data(), data.size(), *frame, region);
+    return {recording.filename, frame, transferred, chrono::steady_clock::now(), data.size()};
+}
+
+INDI::GPhoto::Camera::WriteImage ReplayCamera::write_image() const
+{
+    return [&](CCDChip &chip) { return d->shots.write_image(chip); };
+}
+
+void ReplayCamera::set_frame_ready_callback(const Notify& frame_ready)
+{
+    d->frame_ready = frame_ready;
+}
+
+bool ReplayCamera::settings_changed() const
+{
+    return false;
+}
+
+void ReplayCamera::setup_properties(INDI::Properties::Properties< string >& properties)
+{
+    properties.add_switch("REPLAY_SPEED", d->device, {d->device->getDeviceName(), "REPLAY_SPEED", "Replay Speed", "Main Control"}, ISR_1OFMANY, [=](const vector<Switch::UpdateArgs> &states) {
+        auto on_switch = GuLinux::make_stream(states).first(Switch::On);
+        if(! on_switch)
+            return false;
+        d->realistic = get<1>(*on_switch) == "REPLAY_REALISTIC";
+        return true;
+    }).add("REPLAY_REALISTIC", "Recorded timings", d->realistic ? ISS_ON : ISS_OFF)
+      .add("REPLAY_MAXIMUM", "Maximum speed", d->realistic ? ISS_OFF : ISS_ON);
+}
@@ -0,0 +1,78 @@
+/*
+ * Driver type: GPhoto Camera INDI Driver
+ *
+ * Copyright (C) 2016 Marco Gulino (marco AT gulinux.net)
+ *
+ * This library is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+#ifndef INDI_GPHOTO_REPLAYCAMERA_H
+#define INDI_GPHOTO_REPLAYCAMERA_H
+
+#include "camera.h"
+#include "c++/dptr.h"
+#include <indiccd.h>
+namespace INDI {
+namespace GPhoto {
+/**
+ * Plays back camera files recorded in a directory, through the same worker, decoders and frame pool as RealCamera,
+ * so that transfer and decoding performance can be profiled without a camera attached.
+ * The directory may contain a `manifest.txt` file, listing one recorded shot per line:
+ *
+ *     <file name> <exposure seconds> <transfer seconds>
+ *
+ * Without a manifest every file in the directory is played, in name order, with no transfer time.
+ * Files are played in a loop. At realistic speed each shot lasts its recorded exposure (the requested one if not recorded)
+ * plus its recorded transfer time; at maximum speed files are read and decoded as soon as a shot is requested.
+ */
+class ReplayCamera : public INDI::GPhoto::Camera
+{
+public:
+    ReplayCamera(INDI::CCD *device, const std::string &directory);
+    ~ReplayCamera();
+    virtual std::vector< std::string > available_iso();
+    virtual std::string current_iso();
+    virtual bool set_iso(const std::string& iso);
+    virtual std::vector< std::string > available_formats();
+    virtual std::string current_format();
+    virtual bool set_format(const std::string& format);
+    virtual void set_decode_mode(ImageDecoder::Mode mode);
+    virtual void set_decode_threads(int threads);
+    virtual void set_calibration(const Calibration::Masters::ptr &calibration);
+    virtual void set_statistics_mode(FrameStatistics::Mode mode);
+
+    virtual bool shoot(Seconds seconds, const Frame::Region &region);
+    virtual bool can_shoot() const;
+    virtual void abort();
+    virtual std::size_t frames_in_flight() const;
+    virtual ShootStatus shoot_status() const;
+    virtual FrameTimings last_frame_timings() const;
+    virtual FrameStatistics::Result last_frame_statistics() const;
+    virtual std::string bayer_pattern() const;
+    virtual Preview::ptr take_preview();
+    virtual bool start_live_view();
+    virtual void stop_live_view();
+    virtual Frame::ptr live_view_frame();
+    virtual LiveView::Stats live_view_stats() const;
+    virtual WriteImage write_image() const;
+    virtual void set_frame_ready_callback(const Notify &frame_ready);
+    virtual bool settings_changed() const;
+    virtual void setup_properties(INDI::Properties::Properties< std::string >& properties);
+private:
+    D_PTR;
+};
+}
+}
+
+#endif // INDI_GPHOTO_REPLAYCAMERA_H
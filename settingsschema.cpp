@@ -0,0 +1,165 @@
+/*
+ * Driver type: GPhoto Camera INDI Driver
+ *
+ * Copyright (C) 2016 Marco Gulino (marco AT gulinux.net)
+ *
+ * This library is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+#include "settingsschema.h"
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <cstdlib>
+#include <cstdio>
+#include <cctype>
+#include <sys/stat.h>
+
+using namespace std;
+using namespace INDI::GPhoto;
+
+namespace {
+// One setting per line, tab separated fields; choices are separated by the ASCII unit separator
+const string header = "indi_gphoto_ng settings schema 1";
+const char choices_separator = '\x1f';
+
+string clean(string text)
+{
+    replace_if(text.begin(), text.end(), [](char c) { return c == '\t' || c == '\n' || c == '\r' || c == choices_separator; }, ' ');
+    return text;
+}
+}
+
+bool SettingsSchema::Setting::operator==(const Setting& other) const
+{
+    return type == other.type && name == other.name && label == other.label && group == other.group && read_only == other.read_only &&
+        text == other.text && value == other.value && min == other.min && max == other.max && step == other.step && choices == other.choices;
+}
+
+SettingsSchema SettingsSchema::read(const vector<GPhotoCPP::WidgetPtr>& widgets, const list<string>& excluded)
+{
+    typedef GPhotoCPP::Widget Widget;
+    SettingsSchema schema;
+    for(auto widget: widgets) {
+        if(find(excluded.begin(), excluded.end(), widget->name()) != excluded.end())
+            continue;
+        Setting setting{widget->type(), clean(widget->name()), clean(widget->label()), clean(widget->parent()->label()), widget->access() == Widget::ReadOnly, {}, 0, 0, 0, 0, {}};
+        switch(widget->type()) {
+            case Widget::String:
+                setting.text = clean(widget->get<Widget::StringValue>()->get());
+                break;
+            case Widget::Range: {
+                auto range_value = widget->get<Widget::RangeValue>();
+                auto range = range_value->range();
+                setting.value = range_value->get();
+                setting.min = range.min;
+                setting.max = range.max;
+                setting.step = range.increment;
+                break;
+            }
+            case Widget::Toggle:
+                setting.value = widget->get<Widget::ToggleValue>()->get() ? 1 : 0;
+                break;
+            case Widget::Menu: {
+                auto menu_value = widget->get<Widget::MenuValue>();
+                setting.text = clean(menu_value->get());
+                for(auto choice: menu_value->choices())
+                    setting.choices.push_back(clean(choice));
+                break;
+            }
+            default:
+                continue;
+        }
+        schema.settings.push_back(setting);
+    }
+    return schema;
+}
+
+string SettingsSchema::cache_file(const string& model)
+{
+    const char *home = getenv("HOME");
+    if(! home || model.empty())
+        return {};
+    string directory = string{home} + "/.indi/gphoto_ng";
+    mkdir((string{home} + "/.indi").c_str(), 0755);
+    mkdir(directory.c_str(), 0755);
+    string file_name = model;
+    replace_if(file_name.begin(), file_name.end(), [](char c) { return ! isalnum(static_cast<unsigned char>(c)) && c != '-'; }, '_');
+    return directory + "/" + file_name + ".schema";
+}
+
+bool SettingsSchema::load(const string& file)
+{
+    ifstream input(file);
+    string line;
+    if(file.empty() || ! getline(input, line) || line != header)
+        return false;
+    vector<Setting> loaded;
+    while(getline(input, line)) {
+        vector<string> fields;
+        istringstream line_stream(line);
+        for(string field; getline(line_stream, field, '\t'); )
+            fields.push_back(field);
+        // getline drops the last field when it is empty (no choices)
+        if(fields.size() == 10)
+            fields.emplace_back();
+        if(fields.size() != 11)
+            return false;
+        Setting setting;
+        try {
+            setting.type = static_cast<GPhotoCPP::Widget::Type>(stoi(fields[0]));
+            setting.read_only = fields[4] == "1";
+            setting.value = stod(fields[6]);
+            setting.min = stod(fields[7]);
+            setting.max = stod(fields[8]);
+            setting.step = stod(fields[9]);
+        } catch(std::exception &) {
+            return false;
+        }
+        setting.name = fields[1];
+        setting.label = fields[2];
+        setting.group = fields[3];
+        setting.text = fields[5];
+        istringstream choices_stream(fields[10]);
+        for(string choice; getline(choices_stream, choice, choices_separator); )
+            setting.choices.push_back(choice);
+        loaded.push_back(setting);
+    }
+    settings = loaded;
+    return true;
+}
+
+void SettingsSchema::save(const string& file) const
+{
+    if(file.empty())
+        return;
+    // Written to a temporary file first, so that a concurrent driver never reads a partial schema
+    string temporary_file = file + ".tmp";
+    {
+        ofstream output(temporary_file);
+        output.precision(17);
+        output << header << '\n';
+        for(auto &setting: settings) {
+            output << static_cast<int>(setting.type) << '\t' << setting.name << '\t' << setting.label << '\t' << setting.group << '\t'
+                   << (setting.read_only ? 1 : 0) << '\t' << setting.text << '\t' << setting.value << '\t'
+                   << setting.min << '\t' << setting.max << '\t' << setting.step << '\t';
+            for(size_t index = 0; index < setting.choices.size(); index++)
+                output << (index > 0 ? string(1, choices_separator) : string{}) << setting.choices[index];
+            output << '\n';
+        }
+        if(! output)
+            return;
+    }
+    rename(temporary_file.c_str(), file.c_str());
+}
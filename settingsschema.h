@@ -0,0 +1,67 @@
+/*
+ * Driver type: GPhoto Camera INDI Driver
+ *
+ * Copyright (C) 2016 Marco Gulino (marco AT gulinux.net)
+ *
+ * This library is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+#ifndef INDI_GPHOTO_SETTINGSSCHEMA_H
+#define INDI_GPHOTO_SETTINGSSCHEMA_H
+
+#include <string>
+#include <vector>
+#include <list>
+#include "GPhoto++.h"
+
+namespace INDI {
+namespace GPhoto {
+/**
+ * Description of the camera settings exposed as INDI properties, with their last known values.
+ * It is saved to disk for each camera model, so that properties can be defined at connection time
+ * without reading the whole camera configuration first.
+ */
+struct SettingsSchema
+{
+    struct Setting {
+        GPhotoCPP::Widget::Type type;
+        std::string name;
+        std::string label;
+        std::string group;
+        bool read_only;
+        std::string text; ///< String and Menu value
+        double value; ///< Range value, 1 or 0 for Toggle
+        double min;
+        double max;
+        double step;
+        std::vector<std::string> choices;
+        bool operator==(const Setting &other) const;
+    };
+    std::vector<Setting> settings;
+    bool operator==(const SettingsSchema &other) const { return settings == other.settings; }
+    bool operator!=(const SettingsSchema &other) const { return ! (*this == other); }
+
+    /// Reads the supported widgets (strings, ranges, toggles, menus), except the ones in `excluded`
+    static SettingsSchema read(const std::vector<GPhotoCPP::WidgetPtr> &widgets, const std::list<std::string> &excluded);
+    /// Cache file for a camera model, in the INDI configuration directory. Empty if there is no home directory.
+    static std::string cache_file(const std::string &model);
+    /// Returns false if the file is missing or not a valid schema
+    bool load(const std::string &file);
+    /// Errors are ignored: the cache is just rebuilt on the next connection
+    void save(const std::string &file) const;
+};
+}
+}
+
+#endif // INDI_GPHOTO_SETTINGSSCHEMA_H
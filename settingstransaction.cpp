@@ -0,0 +1,122 @@
+/*
+ * Driver type: GPhoto Camera INDI Driver
+ *
+ * Copyright (C) 2016 Marco Gulino (marco AT gulinux.net)
+ *
+ * This library is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+#include "settingstransaction.h"
+#include <map>
+#include <exception>
+#include <eventloop.h>
+
+using namespace std;
+using namespace INDI::GPhoto;
+
+class SettingsTransaction::Private {
+public:
+    Private(INDI::Utils::Logger &log, const Save &save, const Save &saved, int debounce_ms, SettingsTransaction *q);
+    INDI::Utils::Logger &log;
+    Save save;
+    Save saved;
+    const int debounce_ms;
+    struct Change {
+        Check check;
+        Rejected rejected;
+    };
+    // Keyed by name, so that a setting changed several times is checked once against its last value
+    map<string, Change> changes;
+    int timer_id = -1;
+    uint64_t commits = 0;
+    void stop_timer();
+    static void timer_expired(void *self);
+private:
+    SettingsTransaction *q;
+};
+
+SettingsTransaction::Private::Private(INDI::Utils::Logger& log, const Save& save, const Save& saved, int debounce_ms, SettingsTransaction* q)
+    : log(log), save{save}, saved{saved}, debounce_ms{debounce_ms}, q{q}
+{
+}
+
+SettingsTransaction::SettingsTransaction(INDI::Utils::Logger& log, const Save& save, const Save& saved, int debounce_ms)
+    : dptr(log, save, saved, debounce_ms, this)
+{
+}
+
+SettingsTransaction::~SettingsTransaction()
+{
+    commit();
+}
+
+void SettingsTransaction::Private::stop_timer()
+{
+    if(timer_id == -1)
+        return;
+    IERmTimer(timer_id);
+    timer_id = -1;
+}
+
+void SettingsTransaction::Private::timer_expired(void* self)
+{
+    auto d = reinterpret_cast<SettingsTransaction::Private*>(self);
+    d->timer_id = -1;
+    d->q->commit();
+}
+
+void SettingsTransaction::changed(const string& name, const Check& check, const Rejected &rejected)
+{
+    d->changes[name] = {check, rejected};
+    d->stop_timer();
+    d->timer_id = IEAddTimer(d->debounce_ms, &Private::timer_expired, d.get());
+}
+
+bool SettingsTransaction::pending() const
+{
+    return ! d->changes.empty();
+}
+
+uint64_t SettingsTransaction::commits() const
+{
+    return d->commits;
+}
+
+bool SettingsTransaction::commit()
+{
+    d->stop_timer();
+    if(d->changes.empty())
+        return true;
+    auto changes = move(d->changes);
+    d->changes.clear();
+    d->commits++;
+    d->log.debug() << "Saving " << changes.size() << " changed camera settings";
+    try {
+        d->save();
+        d->saved();
+        bool accepted = true;
+        for(auto change: changes) {
+            if(change.second.check())
+                continue;
+            d->log.error() << "Camera did not accept the new value for " << change.first;
+            accepted = false;
+            if(change.second.rejected)
+                change.second.rejected();
+        }
+        return accepted;
+    } catch(std::exception &e) {
+        d->log.error() << "Error saving camera settings: " << e.what();
+        return false;
+    }
+}
@@ -0,0 +1,61 @@
+/*
+ * Driver type: GPhoto Camera INDI Driver
+ *
+ * Copyright (C) 2016 Marco Gulino (marco AT gulinux.net)
+ *
+ * This library is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+#ifndef INDI_GPHOTO_SETTINGSTRANSACTION_H
+#define INDI_GPHOTO_SETTINGSTRANSACTION_H
+
+#include <string>
+#include <functional>
+#include <cstdint>
+#include "logger.h"
+#include "c++/dptr.h"
+
+namespace INDI {
+namespace GPhoto {
+/**
+ * Collects camera settings changes, so that they are saved to the camera with a single round trip.
+ * Pending changes are committed after a short quiet period (i.e. once a client finished restoring its configuration),
+ * or right away by calling commit(), which must be done before shooting.
+ * After saving, each changed setting is checked, logging the values the camera refused and reporting them to the caller.
+ * Must be used from the INDI event loop only.
+ */
+class SettingsTransaction
+{
+public:
+    typedef std::function<void()> Save;
+    typedef std::function<bool()> Check;
+    typedef std::function<void()> Rejected;
+    /// `save` writes the camera configuration; `saved` is called right after, before checking the values (i.e. to drop cached settings)
+    SettingsTransaction(INDI::Utils::Logger &log, const Save &save, const Save &saved, int debounce_ms = 250);
+    /// Pending changes are committed
+    ~SettingsTransaction();
+    /// Records a changed setting: `check` returns whether the camera holds the expected value after saving, `rejected` is called when not
+    void changed(const std::string &name, const Check &check, const Rejected &rejected = {});
+    bool pending() const;
+    /// Number of commits that saved something, to find out whether the camera configuration changed since a given time
+    uint64_t commits() const;
+    /// Saves pending changes, returning false if saving failed or some value was not accepted
+    bool commit();
+private:
+    D_PTR;
+};
+}
+}
+
+#endif // INDI_GPHOTO_SETTINGSTRANSACTION_H
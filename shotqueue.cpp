@@ -0,0 +1,152 @@
+/*
+ * Driver type: GPhoto Camera INDI Driver
+ *
+ * Copyright (C) 2016 Marco Gulino (marco AT gulinux.net)
+ *
+ * This library is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+#include "shotqueue.h"
+#include <deque>
+
+using namespace std;
+using namespace INDI::GPhoto;
+
+class ShotQueue::Private {
+public:
+    struct Shot {
+        chrono::steady_clock::time_point started;
+        Camera::Seconds duration;
+        Elapsed elapsed;
+        future<Download> download;
+        bool exposing() const { return elapsed() < duration; }
+    };
+    Private(INDI::Utils::Logger &log, ShotQueue *q);
+    INDI::Utils::Logger &log;
+    deque<Shot> shots;
+    deque<Shot> aborted; ///< dropped shots which were still exposing
+    Camera::FrameTimings last_frame_timings;
+    FrameStatistics::Result last_frame_statistics;
+    string bayer_pattern;
+private:
+    ShotQueue *q;
+};
+
+ShotQueue::Private::Private(INDI::Utils::Logger& log, ShotQueue* q) : log{log}, q{q}
+{
+}
+
+ShotQueue::ShotQueue(INDI::Utils::Logger& log) : dptr(log, this)
+{
+}
+
+ShotQueue::~ShotQueue()
+{
+}
+
+void ShotQueue::push(Camera::Seconds duration, const Elapsed& elapsed, future<Download> && download)
+{
+    d->shots.push_back({chrono::steady_clock::now(), duration, elapsed, move(download)});
+}
+
+bool ShotQueue::can_shoot() const
+{
+    while(! d->aborted.empty() && ! d->aborted.front().exposing())
+        d->aborted.pop_front();
+    return d->aborted.empty() && (d->shots.empty() || ! d->shots.back().exposing());
+}
+
+void ShotQueue::abort()
+{
+    for(auto &shot: d->shots) {
+        if(shot.exposing())
+            d->aborted.push_back(move(shot));
+    }
+    d->shots.clear();
+}
+
+size_t ShotQueue::size() const
+{
+    return d->shots.size();
+}
+
+Camera::ShootStatus ShotQueue::status() const
+{
+    if(d->shots.empty())
+        return {Camera::ShootStatus::Idle};
+    auto &shot = d->shots.front();
+    if( shot.download.wait_for(chrono::seconds{0}) == future_status::ready )
+        return {Camera::ShootStatus::Finished, shot.elapsed(), Camera::Seconds{0} };
+    if( ! shot.exposing() )
+        return {Camera::ShootStatus::Downloading, shot.elapsed(), Camera::Seconds{0} };
+    return {Camera::ShootStatus::Running, shot.elapsed(), shot.duration - shot.elapsed() };
+}
+
+bool ShotQueue::write_image(CCDChip& chip)
+{
+    typedef Camera::Seconds Seconds;
+    auto picked_up = chrono::steady_clock::now();
+    auto shot = move(d->shots.front());
+    d->shots.pop_front();
+    Download download;
+    try {
+        download = shot.download.get();
+    } catch(std::exception &e) {
+        d->log.error() << "Exposure failed to download or parse image: " << e.what();
+        return false;
+    }
+    auto exposure_end = shot.started + chrono::duration_cast<chrono::steady_clock::duration>(shot.duration);
+    d->last_frame_timings = {
+        shot.duration,
+        max(Seconds{download.transferred - exposure_end}, Seconds{0}),
+        download.decoded - download.transferred,
+        picked_up - shot.started,
+        max(Seconds{picked_up - download.decoded}, Seconds{0}),
+        Seconds{0},
+        download.bytes,
+    };
+    d->last_frame_statistics = {};
+    if(download.native_file) {
+        d->log.debug() << "Sending " << download.filename << " as is, " << download.native_file->size() << " bytes";
+        d->bayer_pattern.clear();
+        Frame::publish_file(chip, download.native_file->data(), download.native_file->size(), ImageDecoder::extension(download.filename));
+        d->last_frame_timings.publish = chrono::steady_clock::now() - picked_up;
+        return true;
+    }
+    auto geometry = download.frame->geometry();
+    d->log.debug() << "Image filename: " << download.filename << ", w=" << geometry.width << ", h=" << geometry.height << ", bpp=" << geometry.bpp << ", channels=" << geometry.channels;
+    d->bayer_pattern = download.frame->bayer_pattern();
+    if(download.frame->statistics())
+        d->last_frame_statistics = download.frame->statistics()->result();
+    download.frame->publish(chip);
+    download.frame.reset();
+    d->last_frame_timings.publish = chrono::steady_clock::now() - picked_up;
+    chip.setImageExtension("fits");
+    return true;
+}
+
+Camera::FrameTimings ShotQueue::last_frame_timings() const
+{
+    return d->last_frame_timings;
+}
+
+FrameStatistics::Result ShotQueue::last_frame_statistics() const
+{
+    return d->last_frame_statistics;
+}
+
+string ShotQueue::bayer_pattern() const
+{
+    return d->bayer_pattern;
+}
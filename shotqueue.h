@@ -0,0 +1,70 @@
+/*
+ * Driver type: GPhoto Camera INDI Driver
+ *
+ * Copyright (C) 2016 Marco Gulino (marco AT gulinux.net)
+ *
+ * This library is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+#ifndef INDI_GPHOTO_SHOTQUEUE_H
+#define INDI_GPHOTO_SHOTQUEUE_H
+
+#include <future>
+#include <string>
+#include <vector>
+#include <logger.h>
+#include "camera.h"
+#include "c++/dptr.h"
+
+namespace INDI {
+namespace GPhoto {
+/**
+ * Shots started by the cameras shooting files (RealCamera, ReplayCamera), oldest first.
+ * Each shot carries the future of its download, transferred and decoded by the camera worker thread;
+ * write_image() publishes the oldest one to the chip once ready, keeping its timings and statistics.
+ * Must be used from the INDI event loop only.
+ */
+class ShotQueue
+{
+public:
+    struct Download {
+        std::string filename;
+        Frame::ptr frame;
+        std::chrono::steady_clock::time_point transferred;
+        std::chrono::steady_clock::time_point decoded;
+        std::size_t bytes;
+        std::shared_ptr<const std::vector<uint8_t>> native_file; ///< set instead of frame when the file is not decoded
+    };
+    /// Exposure time elapsed since the shot started, as measured by the camera
+    typedef std::function<Camera::Seconds()> Elapsed;
+    ShotQueue(INDI::Utils::Logger &log);
+    ~ShotQueue();
+    void push(Camera::Seconds duration, const Elapsed &elapsed, std::future<Download> &&download);
+    bool can_shoot() const;
+    /// Drops all the shots: their downloads still run, but are discarded
+    void abort();
+    std::size_t size() const;
+    Camera::ShootStatus status() const;
+    /// Publishes the oldest shot, which must be Finished: returns false if its download failed
+    bool write_image(CCDChip &chip);
+    Camera::FrameTimings last_frame_timings() const;
+    FrameStatistics::Result last_frame_statistics() const;
+    std::string bayer_pattern() const;
+private:
+    D_PTR;
+};
+}
+}
+
+#endif // INDI_GPHOTO_SHOTQUEUE_H
@@ -19,9 +19,14 @@
  */
 
 #include "simulationcamera.h"
+#include "simulationgenerator.h"
+#include "parallel.h"
+#include "framepool.h"
 #include <chrono>
 #include "logger.h"
 #include "c++/containers_streams.h"
+#include <thread>
+#include <eventloop.h>
 using namespace std;
 using namespace INDI::GPhoto;
 using namespace GuLinux;
@@ -34,6 +39,11 @@ public:
   string current_iso;
   vector<string> avail_formats;
   string current_format;
+  ImageDecoder::Mode decode_mode = ImageDecoder::FullImage;
+  int decode_threads = 0;
+  Calibration::Masters::ptr calibration;
+  FrameStatistics::Mode statistics_mode = FrameStatistics::Off;
+  FrameStatistics::Result last_frame_statistics;
   struct Exposure {
     Exposure(Seconds seconds) : seconds{seconds}, started{chrono::steady_clock::now()} {}
     Exposure() : valid{false} {}
@@ -44,13 +54,24 @@ public:
     bool finished() const { return elapsed() >= seconds; }
   };
   Exposure exposure;
+  Frame::Region region;
+  uint64_t frame_number = 0;
+  SimulationGenerator generator;
+  FramePool::ptr frame_pool;
+  string bayer_pattern;
+  FrameTimings last_frame_timings;
+  unique_ptr<LiveView> live_view;
   INDI::Utils::Logger log;
+  Notify frame_ready = []{};
+  int exposure_timer = -1;
+  static void exposure_done(void *self);
 private:
   SimulationCamera *q;
 };
 
 SimulationCamera::Private::Private(INDI::CCD* device, SimulationCamera* q)
-  : device{device}, avail_iso{"100", "200", "400", "800"}, current_iso{"200"}, avail_formats{"RAW", "JPEG"}, current_format{"RAW"}, log{device, "SimulationCamera"}, q{q}
+  : device{device}, avail_iso{"100", "200", "400", "800"}, current_iso{"200"}, avail_formats{"RAW", "JPEG"}, current_format{"RAW"},
+    generator{SimulationGenerator::Settings{}}, frame_pool{make_shared<FramePool>()}, log{device, "SimulationCamera"}, q{q}
 {
 }
 
@@ -61,6 +82,20 @@ SimulationCamera::SimulationCamera(INDI::CCD* device) : dptr(device, this)
 
 SimulationCamera::~SimulationCamera()
 {
+  if(d->exposure_timer != -1)
+    IERmTimer(d->exposure_timer);
+}
+
+void SimulationCamera::Private::exposure_done(void* self)
+{
+  auto d = reinterpret_cast<SimulationCamera::Private*>(self);
+  d->exposure_timer = -1;
+  d->frame_ready();
+}
+
+void SimulationCamera::set_frame_ready_callback(const Notify& frame_ready)
+{
+  d->frame_ready = frame_ready;
 }
 
 vector< string > SimulationCamera::available_iso()
@@ -94,13 +129,81 @@ bool SimulationCamera::set_format(const string& format)
   d->current_format = format; return true;
 }
 
-bool SimulationCamera::shoot(Camera::Seconds seconds)
+void SimulationCamera::set_decode_mode(ImageDecoder::Mode mode)
+{
+  d->decode_mode = mode;
+}
+
+void SimulationCamera::set_decode_threads(int threads)
+{
+  d->decode_threads = threads;
+}
+
+void SimulationCamera::set_calibration(const Calibration::Masters::ptr& calibration)
+{
+  d->calibration = calibration;
+}
+
+void SimulationCamera::set_statistics_mode(FrameStatistics::Mode mode)
 {
+  d->statistics_mode = mode;
+}
+
+bool SimulationCamera::shoot(Camera::Seconds seconds, const Frame::Region &region)
+{
+  if(!can_shoot())
+    return false;
   d->log.debug() << "Shooting for " << seconds.count() << " seconds.";
   d->exposure = {seconds};
+  d->region = region;
+  // One extra millisecond, so that the exposure is already reported as finished when the timer fires
+  d->exposure_timer = IEAddTimer(static_cast<int>(seconds.count() * 1000) + 1, &Private::exposure_done, d.get());
   return true;
 }
 
+bool SimulationCamera::can_shoot() const
+{
+  return !d->exposure.valid && !d->live_view;
+}
+
+void SimulationCamera::abort()
+{
+  if(d->exposure_timer != -1)
+    IERmTimer(d->exposure_timer);
+  d->exposure_timer = -1;
+  d->exposure = {};
+}
+
+size_t SimulationCamera::frames_in_flight() const
+{
+  return d->exposure.valid ? 1 : 0;
+}
+
+Camera::FrameTimings SimulationCamera::last_frame_timings() const
+{
+  return d->last_frame_timings;
+}
+
+FrameStatistics::Result SimulationCamera::last_frame_statistics() const
+{
+  return d->last_frame_statistics;
+}
+
+string SimulationCamera::bayer_pattern() const
+{
+  return d->bayer_pattern;
+}
+
+bool SimulationCamera::settings_changed() const
+{
+  return false;
+}
+
+Camera::Preview::ptr SimulationCamera::take_preview()
+{
+  return {};
+}
+
 Camera::ShootStatus SimulationCamera::shoot_status() const
 {
   if(!d->exposure.valid)
@@ -113,29 +216,108 @@ Camera::ShootStatus SimulationCamera::shoot_status() const
 INDI::GPhoto::Camera::WriteImage SimulationCamera::write_image() const
 {
   return [&](CCDChip &chip){
-    d->log.debug() << "Writing image to chip";
-    // Get width and height
-    int width = chip.getSubW() / chip.getBinX() * chip.getBPP()/8;
-    int height = chip.getSubH() / chip.getBinY();
-    d->log.debug() << "w=" << width << ", h=" << height;
-    chip.setFrameBufferSize(width*height);
-    uint8_t * image = chip.getFrameBuffer();
-
-    // Fill buffer with random pattern
-    for (int i=0; i < height ; i++) {
-	if(i%10 == 0)
-	  d->log.debug() << "Row " << i;
-        for (int j=0; j < width; j++)
-            image[i*width+j] = rand() % 255;
+    auto started = chrono::steady_clock::now();
+    Parallel::set_threads(d->decode_threads);
+    SimulationGenerator::Shot shot{d->exposure.seconds, stoi(d->current_iso), d->frame_number++};
+    d->last_frame_statistics = {};
+    if(d->decode_mode == ImageDecoder::Native) {
+      // A JPEG file is the only camera file the simulation can write
+      auto file = d->generator.jpeg(shot);
+      auto generated = chrono::steady_clock::now();
+      d->bayer_pattern.clear();
+      Frame::publish_file(chip, file.data(), file.size(), "jpg");
+      d->last_frame_timings = {d->exposure.seconds, Seconds{0}, generated - started, d->exposure.elapsed(), Seconds{0}, chrono::steady_clock::now() - generated, file.size()};
+      d->exposure.valid = false;
+      return true;
+    }
+    auto frame = make_shared<Frame>(d->frame_pool);
+    frame->set_calibration(d->calibration);
+    if(d->statistics_mode != FrameStatistics::Off)
+      frame->set_statistics(make_shared<FrameStatistics>(d->statistics_mode));
+    try {
+      // JPEG images go through an actual file and the real decoder, just like the ones downloaded from a camera
+      if(d->current_format == "JPEG") {
+        auto file = d->generator.jpeg(shot);
+        JPEGDecoder{d->decode_mode}.decode(file.data(), file.size(), *frame, d->region);
+      } else {
+        d->generator.render(*frame, shot, d->decode_mode, d->region);
+      }
+    } catch(std::exception &e) {
+      d->log.error() << "Unable to generate image: " << e.what();
+      d->exposure.valid = false;
+      return false;
     }
-    d->log.debug() << "Finished generating random image";
+    d->log.debug() << "Generated frame " << shot.frame_number << ": w=" << frame->geometry().width << ", h=" << frame->geometry().height;
+    d->bayer_pattern = frame->bayer_pattern();
+    auto generated = chrono::steady_clock::now();
+    if(frame->statistics())
+      d->last_frame_statistics = frame->statistics()->result();
+    frame->publish(chip);
+    chip.setImageExtension("fits");
+    d->last_frame_timings = {d->exposure.seconds, Seconds{0}, generated - started, d->exposure.elapsed(), Seconds{0}, chrono::steady_clock::now() - generated, 0};
     d->exposure.valid = false;
     return true;
   };
 }
 
 
+bool SimulationCamera::start_live_view()
+{
+  if(d->exposure.valid)
+    return false;
+  // Synthetic 25 fps stream: a gradient moving one pixel per frame
+  auto next_frame = make_shared<chrono::steady_clock::time_point>(chrono::steady_clock::now());
+  auto frame_number = make_shared<int>(0);
+  d->live_view.reset(new LiveView{[=](Frame &frame) {
+    *next_frame += chrono::milliseconds{40};
+    this_thread::sleep_until(*next_frame);
+    frame.resize({640, 480, 1, 8});
+    uint8_t *pixels = frame.plane<uint8_t>(0);
+    for(int y = 0; y < 480; y++)
+      for(int x = 0; x < 640; x++)
+        pixels[y * 640 + x] = (x + y + *frame_number) % 256;
+    (*frame_number)++;
+  }});
+  return true;
+}
+
+void SimulationCamera::stop_live_view()
+{
+  d->live_view.reset();
+}
+
+Frame::ptr SimulationCamera::live_view_frame()
+{
+  return d->live_view ? d->live_view->take_frame() : Frame::ptr{};
+}
+
+LiveView::Stats SimulationCamera::live_view_stats() const
+{
+  return d->live_view ? d->live_view->stats() : LiveView::Stats{0, 0, 0};
+}
+
 void SimulationCamera::setup_properties(INDI::Properties::Properties< std::string >& properties)
 {
+  auto settings = d->generator.settings();
+  properties.add_number("SIMULATION", d->device, {d->device->getDeviceName(), "SIMULATION", "Simulated Sensor", "Simulation", IP_RW}, [=](const vector<INDI::Properties::Number::UpdateArgs> &values) {
+    if(d->exposure.valid)
+      return false;
+    auto settings = d->generator.settings();
+    for(auto value: values) {
+      if(get<1>(value) == "SIMULATION_WIDTH")
+        settings.width = get<0>(value);
+      if(get<1>(value) == "SIMULATION_HEIGHT")
+        settings.height = get<0>(value);
+      if(get<1>(value) == "SIMULATION_SEED")
+        settings.seed = get<0>(value);
+      if(get<1>(value) == "SIMULATION_STARS")
+        settings.stars = get<0>(value);
+    }
+    d->generator.set_settings(settings);
+    return true;
+  }).add("SIMULATION_WIDTH", "Width", 64, 12000, 2, settings.width, "%.0f")
+    .add("SIMULATION_HEIGHT", "Height", 64, 8000, 2, settings.height, "%.0f")
+    .add("SIMULATION_SEED", "Random seed", 0, 1e9, 1, settings.seed, "%.0f")
+    .add("SIMULATION_STARS", "Stars", 0, 100000, 1, settings.stars, "%.0f");
 }
 
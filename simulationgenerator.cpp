@@ -0,0 +1,240 @@
+/*
+ * Driver type: GPhoto Camera INDI Driver
+ *
+ * Copyright (C) 2016 Marco Gulino (marco AT gulinux.net)
+ *
+ * This library is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+#include "simulationgenerator.h"
+#include "framewriter.h"
+#include "parallel.h"
+#include <cmath>
+#include <cstdio>
+#include <algorithm>
+#include <jpeglib.h>
+
+using namespace std;
+using namespace INDI::GPhoto;
+
+namespace {
+// Sensor model: 16 bit ADC, 0.25 ADU per electron at ISO 100
+const float BIAS = 2048;
+const float MAX_ADU = 65535;
+const float GAIN_ISO_100 = 0.25;
+const float READ_NOISE = 3; // electrons
+const float SKY = 20; // electrons per second and pixel
+const float STRETCH_WHITE = 16384; // ADU mapped to white in JPEG images
+
+// splitmix64: tiny state, so each row can cheaply get its own generator
+class Random {
+public:
+    Random(uint64_t seed) : state{seed} {}
+    uint64_t next() {
+        uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+    float uniform() { return (next() >> 40) * (1.0f / (1 << 24)); }
+    /// Approximately normal (sum of four uniforms), one draw per sample
+    float gaussian() {
+        uint64_t bits = next();
+        uint32_t sum = (bits & 0xFFFF) + ((bits >> 16) & 0xFFFF) + ((bits >> 32) & 0xFFFF) + (bits >> 48);
+        return (sum * (1.0f / 65536) - 2.0f) * 1.7320508f;
+    }
+private:
+    uint64_t state;
+};
+
+/// Color of the RGGB filter over a sensor pixel: 0 red, 1 green, 2 blue
+inline int filter_color(int x, int y)
+{
+    return (y & 1) == 0 ? (x & 1) : 1 + (x & 1);
+}
+
+string pattern_at(int x, int y)
+{
+    string pattern;
+    for(auto position: {make_pair(0, 0), make_pair(1, 0), make_pair(0, 1), make_pair(1, 1)})
+        pattern += "RGB"[filter_color(x + position.first, y + position.second)];
+    return pattern;
+}
+}
+
+class SimulationGenerator::Private {
+public:
+    Private(const Settings &settings, SimulationGenerator *q);
+    struct Star {
+        float x, y;
+        float flux; // electrons per second
+        float sigma;
+        float color[3];
+    };
+    Settings settings;
+    vector<Star> stars; // sorted by y
+    float max_reach = 0;
+    vector<uint16_t> rows;
+    vector<uint8_t> stretch;
+    void make_stars();
+    /// Renders row `y` of the image scaled down by `scale`, with `channels` components per pixel (1 for the color filter array mosaic)
+    void render_row(const Shot &shot, int scale, int channels, int y, int width, float *electrons, uint16_t *destination) const;
+private:
+    SimulationGenerator *q;
+};
+
+SimulationGenerator::Private::Private(const Settings& settings, SimulationGenerator* q) : settings{settings}, stretch(65536), q{q}
+{
+    for(size_t adu = 0; adu < stretch.size(); adu++)
+        stretch[adu] = static_cast<uint8_t>(255 * sqrt(min(1.0f, max(0.0f, (adu - BIAS) / (STRETCH_WHITE - BIAS)))) + 0.5f);
+    make_stars();
+}
+
+SimulationGenerator::SimulationGenerator(const Settings& settings) : dptr(settings, this)
+{
+}
+
+SimulationGenerator::~SimulationGenerator()
+{
+}
+
+const SimulationGenerator::Settings& SimulationGenerator::settings() const
+{
+    return d->settings;
+}
+
+void SimulationGenerator::set_settings(const Settings& settings)
+{
+    d->settings = settings;
+    d->make_stars();
+}
+
+void SimulationGenerator::Private::make_stars()
+{
+    Random random{settings.seed};
+    stars.resize(max(settings.stars, 0));
+    max_reach = 0;
+    for(auto &star: stars) {
+        star.x = random.uniform() * settings.width;
+        star.y = random.uniform() * settings.height;
+        // Few bright stars, many faint ones
+        star.flux = min(200.0f * pow(max(random.uniform(), 1e-4f), -1.5f), 2e6f);
+        star.sigma = 1.2f + 0.8f * random.uniform();
+        float temperature = random.uniform();
+        star.color[0] = 0.7f + 0.6f * temperature;
+        star.color[1] = 1;
+        star.color[2] = 1.3f - 0.6f * temperature;
+        max_reach = max(max_reach, 4 * star.sigma);
+    }
+    sort(stars.begin(), stars.end(), [](const Star &a, const Star &b) { return a.y < b.y; });
+}
+
+void SimulationGenerator::Private::render_row(const Shot& shot, int scale, int channels, int y, int width, float* electrons, uint16_t* destination) const
+{
+    const float exposure = shot.exposure.count();
+    const float pixel_area = scale * scale;
+    const size_t components = static_cast<size_t>(width) * channels;
+    fill(electrons, electrons + components, SKY * exposure * pixel_area);
+    const float sensor_y = (y + 0.5f) * scale;
+    auto star = lower_bound(stars.begin(), stars.end(), sensor_y - max_reach, [](const Star &s, float y) { return s.y < y; });
+    for(; star != stars.end() && star->y <= sensor_y + max_reach; ++star) {
+        const float reach = 4 * star->sigma;
+        const float dy = sensor_y - star->y;
+        if(fabs(dy) > reach)
+            continue;
+        const float inverse_variance = 1 / (2 * star->sigma * star->sigma);
+        const float peak = star->flux * exposure * pixel_area * inverse_variance / static_cast<float>(M_PI) * exp(-dy * dy * inverse_variance);
+        const int first = max(0, static_cast<int>((star->x - reach) / scale));
+        const int last = min(width - 1, static_cast<int>((star->x + reach) / scale));
+        for(int x = first; x <= last; x++) {
+            const float dx = (x + 0.5f) * scale - star->x;
+            const float value = peak * exp(-dx * dx * inverse_variance);
+            if(channels == 1)
+                electrons[x] += value * star->color[filter_color(x, y)];
+            else
+                for(int channel = 0; channel < channels; channel++)
+                    electrons[x * channels + channel] += value * star->color[channel];
+        }
+    }
+    const float gain = GAIN_ISO_100 * shot.iso / 100;
+    Random random{settings.seed ^ (shot.frame_number * 0xD1B54A32D192ED03ULL) ^ (static_cast<uint64_t>(y) * 0x9E3779B97F4A7C15ULL + scale)};
+    for(size_t index = 0; index < components; index++) {
+        const float signal = electrons[index];
+        const float noise = sqrt(signal + READ_NOISE * READ_NOISE) * random.gaussian();
+        destination[index] = static_cast<uint16_t>(min(MAX_ADU, max(0.0f, BIAS + gain * (signal + noise))));
+    }
+}
+
+void SimulationGenerator::render(Frame& frame, const Shot& shot, ImageDecoder::Mode mode, const Frame::Region& region)
+{
+    const int scale = mode == ImageDecoder::HalfSize ? 2 : (mode == ImageDecoder::Preview ? 4 : 1);
+    const int channels = mode == ImageDecoder::Bayer ? 1 : 3;
+    const int width = d->settings.width / scale;
+    FrameWriter writer{frame, region, width, d->settings.height / scale, channels, 16};
+    const Frame::Region &written = writer.region();
+    // Binning mixes the colors of each cell, leaving a monochrome image
+    if(mode == ImageDecoder::Bayer && ! written.binned())
+        frame.set_bayer_pattern(pattern_at(written.x, written.y));
+    const size_t row_size = static_cast<size_t>(width) * channels;
+    d->rows.resize(row_size * written.height);
+    Parallel::for_rows(written.height, [&](int begin, int end) {
+        vector<float> electrons(row_size);
+        for(int row = begin; row < end; row++)
+            d->render_row(shot, scale, channels, written.y + row, width, electrons.data(), d->rows.data() + row * row_size);
+    });
+    for(int row = 0; row < written.height; row++)
+        writer.write_row(written.y + row, d->rows.data() + row * row_size, channels);
+}
+
+vector<uint8_t> SimulationGenerator::jpeg(const Shot& shot, int quality)
+{
+    const int width = d->settings.width;
+    const int height = d->settings.height;
+    const size_t row_size = static_cast<size_t>(width) * 3;
+    vector<uint8_t> image(row_size * height);
+    Parallel::for_rows(height, [&](int begin, int end) {
+        vector<float> electrons(row_size);
+        vector<uint16_t> row(row_size);
+        for(int y = begin; y < end; y++) {
+            d->render_row(shot, 1, 3, y, width, electrons.data(), row.data());
+            transform(row.begin(), row.end(), image.begin() + y * row_size, [this](uint16_t adu) { return d->stretch[adu]; });
+        }
+    });
+
+    // Compressing valid scanlines into memory can only fail when out of memory, where libjpeg default handler aborts anyway
+    jpeg_compress_struct cinfo;
+    jpeg_error_mgr error_manager;
+    cinfo.err = jpeg_std_error(&error_manager);
+    jpeg_create_compress(&cinfo);
+    unsigned char *buffer = nullptr;
+    unsigned long size = 0;
+    jpeg_mem_dest(&cinfo, &buffer, &size);
+    cinfo.image_width = width;
+    cinfo.image_height = height;
+    cinfo.input_components = 3;
+    cinfo.in_color_space = JCS_RGB;
+    jpeg_set_defaults(&cinfo);
+    jpeg_set_quality(&cinfo, quality, TRUE);
+    cinfo.dct_method = JDCT_IFAST;
+    jpeg_start_compress(&cinfo, TRUE);
+    while(cinfo.next_scanline < cinfo.image_height) {
+        JSAMPROW scanline = image.data() + cinfo.next_scanline * row_size;
+        jpeg_write_scanlines(&cinfo, &scanline, 1);
+    }
+    jpeg_finish_compress(&cinfo);
+    jpeg_destroy_compress(&cinfo);
+    vector<uint8_t> file{buffer, buffer + size};
+    free(buffer);
+    return file;
+}
@@ -0,0 +1,72 @@
+/*
+ * Driver type: GPhoto Camera INDI Driver
+ *
+ * Copyright (C) 2016 Marco Gulino (marco AT gulinux.net)
+ *
+ * This library is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+#ifndef INDI_GPHOTO_SIMULATIONGENERATOR_H
+#define INDI_GPHOTO_SIMULATIONGENERATOR_H
+
+#include <cstdint>
+#include <vector>
+#include <chrono>
+#include "frame.h"
+#include "imagedecoder.h"
+#include "c++/dptr.h"
+
+namespace INDI {
+namespace GPhoto {
+/**
+ * Synthetic sensor images for the simulation camera: a star field over the sky background, with photon and read noise
+ * depending on exposure and ISO, seen through an RGGB color filter array.
+ * Images only depend on the settings, exposure, ISO and frame number, so runs are reproducible.
+ * Rows are rendered in parallel, each with its own random generator seeded from its position,
+ * so the result doesn't depend on the number of threads either.
+ */
+class SimulationGenerator
+{
+public:
+    typedef std::chrono::duration<double> Seconds;
+    struct Settings {
+        int width = 5184;
+        int height = 3456;
+        uint64_t seed = 1;
+        int stars = 500;
+    };
+    struct Shot {
+        Seconds exposure;
+        int iso;
+        uint64_t frame_number;
+    };
+    SimulationGenerator(const Settings &settings);
+    ~SimulationGenerator();
+    const Settings &settings() const;
+    void set_settings(const Settings &settings);
+    /**
+     * Renders the image as it would be decoded from a raw file: a single 16 bit mosaic plane in Bayer mode,
+     * 16 bit RGB planes otherwise (at half or quarter resolution for the reduced modes).
+     */
+    void render(Frame &frame, const Shot &shot, ImageDecoder::Mode mode, const Frame::Region &region = {});
+    /// JPEG file of the whole image, as saved by the camera
+    std::vector<uint8_t> jpeg(const Shot &shot, int quality = 90);
+    static const char *bayer_pattern() { return "RGGB"; }
+private:
+    D_PTR;
+};
+}
+}
+
+#endif // INDI_GPHOTO_SIMULATIONGENERATOR_H
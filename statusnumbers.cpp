@@ -0,0 +1,94 @@
+/*
+ * Driver type: GPhoto Camera INDI Driver
+ *
+ * Copyright (C) 2016 Marco Gulino (marco AT gulinux.net)
+ *
+ * This library is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+#include "statusnumbers.h"
+#include <vector>
+#include <map>
+
+using namespace std;
+using namespace INDI::GPhoto;
+
+class StatusNumbers::Private {
+public:
+    Private(INDI::DefaultDevice *device, const string &name, const string &label, const string &group, StatusNumbers *q);
+    INDI::DefaultDevice *device;
+    const string name;
+    const string label;
+    const string group;
+    vector<INumber> numbers;
+    map<string, size_t> indexes;
+    INumberVectorProperty property;
+    bool defined = false;
+private:
+    StatusNumbers *q;
+};
+
+StatusNumbers::Private::Private(INDI::DefaultDevice* device, const string& name, const string& label, const string& group, StatusNumbers* q)
+    : device{device}, name{name}, label{label}, group{group}, q{q}
+{
+}
+
+StatusNumbers::StatusNumbers(INDI::DefaultDevice* device, const string& name, const string& label, const string& group)
+    : dptr(device, name, label, group, this)
+{
+}
+
+StatusNumbers::~StatusNumbers()
+{
+    remove();
+}
+
+StatusNumbers& StatusNumbers::add(const string& name, const string& label, const string& format)
+{
+    INumber number;
+    IUFillNumber(&number, name.c_str(), label.c_str(), format.c_str(), 0, 0, 0, 0);
+    d->indexes[name] = d->numbers.size();
+    d->numbers.push_back(number);
+    return *this;
+}
+
+void StatusNumbers::define()
+{
+    if(d->defined)
+        return;
+    IUFillNumberVector(&d->property, d->numbers.data(), d->numbers.size(), d->device->getDeviceName(), d->name.c_str(), d->label.c_str(), d->group.c_str(), IP_RO, 60, IPS_IDLE);
+    d->device->defineNumber(&d->property);
+    d->defined = true;
+}
+
+void StatusNumbers::remove()
+{
+    if(! d->defined)
+        return;
+    d->device->deleteProperty(d->name.c_str());
+    d->defined = false;
+}
+
+void StatusNumbers::set(const string& name, double value)
+{
+    d->numbers[d->indexes.at(name)].value = value;
+}
+
+void StatusNumbers::send(IPState state)
+{
+    if(! d->defined)
+        return;
+    d->property.s = state;
+    IDSetNumber(&d->property, nullptr);
+}
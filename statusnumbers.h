@@ -0,0 +1,49 @@
+/*
+ * Driver type: GPhoto Camera INDI Driver
+ *
+ * Copyright (C) 2016 Marco Gulino (marco AT gulinux.net)
+ *
+ * This library is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+#ifndef INDI_GPHOTO_STATUSNUMBERS_H
+#define INDI_GPHOTO_STATUSNUMBERS_H
+
+#include <string>
+#include <indiccd.h>
+#include "c++/dptr.h"
+
+namespace INDI {
+namespace GPhoto {
+/**
+ * Read only number vector, for publishing driver status values to clients.
+ * Must be used from the INDI event loop only.
+ */
+class StatusNumbers
+{
+public:
+    StatusNumbers(INDI::DefaultDevice *device, const std::string &name, const std::string &label, const std::string &group);
+    ~StatusNumbers();
+    StatusNumbers &add(const std::string &name, const std::string &label, const std::string &format = "%.0f");
+    void define();
+    void remove();
+    void set(const std::string &name, double value);
+    void send(IPState state = IPS_OK);
+private:
+    D_PTR;
+};
+}
+}
+
+#endif // INDI_GPHOTO_STATUSNUMBERS_H
@@ -0,0 +1,82 @@
+/*
+ * Driver type: GPhoto Camera INDI Driver
+ *
+ * Copyright (C) 2016 Marco Gulino (marco AT gulinux.net)
+ *
+ * This library is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+#include "transferscheduler.h"
+#include <mutex>
+#include <condition_variable>
+#include <cstdint>
+
+using namespace std;
+using namespace INDI::GPhoto;
+
+class TransferScheduler::Private {
+public:
+    Private(TransferScheduler *q);
+    mutex lock;
+    condition_variable served;
+    // Ticket lock: transfers start in the order they were requested
+    uint64_t next_ticket = 0;
+    uint64_t serving = 0;
+private:
+    TransferScheduler *q;
+};
+
+TransferScheduler::Private::Private(TransferScheduler* q) : q{q}
+{
+}
+
+TransferScheduler::TransferScheduler() : dptr(this)
+{
+}
+
+TransferScheduler::~TransferScheduler()
+{
+}
+
+TransferScheduler& TransferScheduler::instance()
+{
+    static TransferScheduler scheduler;
+    return scheduler;
+}
+
+void TransferScheduler::acquire()
+{
+    unique_lock<mutex> lock(d->lock);
+    const uint64_t ticket = d->next_ticket++;
+    d->served.wait(lock, [&] { return d->serving == ticket; });
+}
+
+void TransferScheduler::release()
+{
+    {
+        lock_guard<mutex> lock(d->lock);
+        d->serving++;
+    }
+    d->served.notify_all();
+}
+
+TransferScheduler::Slot::Slot()
+{
+    TransferScheduler::instance().acquire();
+}
+
+TransferScheduler::Slot::~Slot()
+{
+    TransferScheduler::instance().release();
+}
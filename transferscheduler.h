@@ -0,0 +1,54 @@
+/*
+ * Driver type: GPhoto Camera INDI Driver
+ *
+ * Copyright (C) 2016 Marco Gulino (marco AT gulinux.net)
+ *
+ * This library is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+#ifndef INDI_GPHOTO_TRANSFERSCHEDULER_H
+#define INDI_GPHOTO_TRANSFERSCHEDULER_H
+
+#include "c++/dptr.h"
+
+namespace INDI {
+namespace GPhoto {
+/**
+ * Process wide queue for the USB transfers the driver runs back to back (i.e. live view frames).
+ * With several cameras on the same bus, transfers are served in request order, one at a time,
+ * so that a camera looping on transfers can't starve the others.
+ * A Slot is held for the whole transfer: its constructor blocks until the transfer can start.
+ */
+class TransferScheduler
+{
+public:
+    class Slot {
+    public:
+        Slot();
+        ~Slot();
+        Slot(const Slot &) = delete;
+        Slot &operator=(const Slot &) = delete;
+    };
+    static TransferScheduler &instance();
+    ~TransferScheduler();
+private:
+    TransferScheduler();
+    void acquire();
+    void release();
+    D_PTR;
+};
+}
+}
+
+#endif // INDI_GPHOTO_TRANSFERSCHEDULER_H
@@ -0,0 +1,91 @@
+/*
+ * Driver type: GPhoto Camera INDI Driver
+ *
+ * Copyright (C) 2016 Marco Gulino (marco AT gulinux.net)
+ *
+ * This library is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+#ifndef INDI_GPHOTO_WIDGETINDEX_H
+#define INDI_GPHOTO_WIDGETINDEX_H
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <functional>
+#include <unordered_map>
+#include <cstdint>
+
+namespace INDI {
+namespace GPhoto {
+/**
+ * Name to widget lookup table over the camera configuration tree.
+ * The tree is fetched and indexed on first use, then kept until invalidate() is called (i.e. when a setting
+ * may have changed other parts of the configuration), so that reading or writing a setting costs a hash lookup
+ * instead of fetching the configuration and walking its tree.
+ * Widget is a template parameter only so that the index can be benchmarked without a camera.
+ */
+template<typename Widget> class WidgetIndex
+{
+public:
+    typedef std::shared_ptr<Widget> WidgetPtr;
+    typedef std::function<WidgetPtr()> Fetch;
+    struct Stats {
+        uint64_t lookups;
+        uint64_t fetches;
+    };
+    WidgetIndex(const Fetch &fetch) : fetch{fetch} {}
+    /// Widget with the given name, or an empty pointer if the camera has no such setting
+    WidgetPtr find(const std::string &name) {
+        stats.lookups++;
+        auto widget = index().find(name);
+        return widget == widgets.end() ? WidgetPtr{} : widget->second;
+    }
+    /// All widgets in the configuration tree, in tree order
+    const std::vector<WidgetPtr> &all() { index(); return ordered; }
+    void invalidate() { root.reset(); widgets.clear(); ordered.clear(); }
+    /// Indexes an already fetched configuration tree, unless the index is already built
+    void adopt(const WidgetPtr &tree) {
+        if(root)
+            return;
+        root = tree;
+        build();
+    }
+    Stats statistics() const { return stats; }
+private:
+    const std::unordered_map<std::string, WidgetPtr> &index() {
+        if(root)
+            return widgets;
+        root = fetch();
+        stats.fetches++;
+        build();
+        return widgets;
+    }
+    void build() {
+        auto children = root->all_children();
+        ordered.assign(children.begin(), children.end());
+        widgets.reserve(ordered.size());
+        for(auto widget: ordered)
+            widgets[widget->name()] = widget;
+    }
+    Fetch fetch;
+    WidgetPtr root;
+    std::unordered_map<std::string, WidgetPtr> widgets;
+    std::vector<WidgetPtr> ordered;
+    Stats stats{0, 0};
+};
+}
+}
+
+#endif // INDI_GPHOTO_WIDGETINDEX_H
@@ -0,0 +1,86 @@
+/*
+ * Driver type: GPhoto Camera INDI Driver
+ *
+ * Copyright (C) 2016 Marco Gulino (marco AT gulinux.net)
+ *
+ * This library is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#include "worker.h"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+
+using namespace std;
+using namespace INDI::GPhoto;
+
+class Worker::Private {
+public:
+    Private(Worker *q);
+    mutex tasks_mutex;
+    condition_variable tasks_changed;
+    deque<Task> tasks;
+    bool stopped = false;
+    thread worker_thread;
+    void run();
+private:
+    Worker *q;
+};
+
+Worker::Private::Private(Worker* q) : q{q}
+{
+}
+
+void Worker::Private::run()
+{
+    while(true) {
+        Task task;
+        {
+            unique_lock<mutex> lock(tasks_mutex);
+            tasks_changed.wait(lock, [this] { return stopped || ! tasks.empty(); });
+            if(stopped)
+                return;
+            task = tasks.front();
+            tasks.pop_front();
+        }
+        task();
+    }
+}
+
+Worker::Worker() : dptr(this)
+{
+    d->worker_thread = thread{bind(&Private::run, d.get())};
+}
+
+Worker::~Worker()
+{
+    {
+        lock_guard<mutex> lock(d->tasks_mutex);
+        d->stopped = true;
+        d->tasks.clear();
+    }
+    d->tasks_changed.notify_all();
+    d->worker_thread.join();
+}
+
+void Worker::enqueue(const Task& task)
+{
+    {
+        lock_guard<mutex> lock(d->tasks_mutex);
+        d->tasks.push_back(task);
+    }
+    d->tasks_changed.notify_one();
+}
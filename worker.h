@@ -0,0 +1,62 @@
+/*
+ * Driver type: GPhoto Camera INDI Driver
+ *
+ * Copyright (C) 2016 Marco Gulino (marco AT gulinux.net)
+ *
+ * This library is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#ifndef INDI_GPHOTO_WORKER_H
+#define INDI_GPHOTO_WORKER_H
+
+#include <functional>
+#include <future>
+#include <memory>
+#include "c++/dptr.h"
+
+namespace INDI {
+namespace GPhoto {
+/**
+ * Single background thread running queued tasks in order.
+ * Results (and exceptions) are handed back through std::future, so the INDI event loop never blocks on them.
+ * Pending tasks are dropped on destruction, their futures reporting a broken promise.
+ */
+class Worker
+{
+public:
+    typedef std::function<void()> Task;
+    Worker();
+    ~Worker();
+    /// `done` is called by the worker thread once the result is available through the future (i.e. to wake up the event loop)
+    template<typename T> std::future<T> queue(const std::function<T()> &task, const Task &done = {});
+private:
+    void enqueue(const Task &task);
+    D_PTR;
+};
+
+template<typename T> std::future<T> Worker::queue(const std::function<T()> &task, const Task &done)
+{
+    auto packaged_task = std::make_shared<std::packaged_task<T()>>(task);
+    enqueue([packaged_task, done] {
+        (*packaged_task)();
+        if(done)
+            done();
+    });
+    return packaged_task->get_future();
+}
+}
+}
+
+#endif // INDI_GPHOTO_WORKER_H